@@ -0,0 +1,245 @@
+// Copyright 2018, Institute for Artificial Intelligence - University of Bremen
+// Author: Andrei Haidu (http://haidu.eu)
+
+#include "MCControlBenchCommandlet.h"
+#include "MCMovementController6D.h"
+#include "Components/SphereComponent.h"
+#include "Engine/World.h"
+#include "HAL/PlatformTime.h"
+
+namespace
+{
+	/**
+	* Per frame control before the control kernels, one member function per control type
+	* called through function pointers, the body accessors lock the physics scene on every call
+	*/
+	struct FMCFunctionPtrControl
+	{
+		typedef void(FMCFunctionPtrControl::*ControlFuncPtrType)(float);
+
+		// Select the control functions of the control types
+		void Init(EMCLocationControlType InLocationType, EMCRotationControlType InRotationType)
+		{
+			switch (InLocationType)
+			{
+			case EMCLocationControlType::Force:
+				LocationControlFuncPtr = &FMCFunctionPtrControl::LocationControl_ForceBased;
+				break;
+			case EMCLocationControlType::Acceleration:
+				LocationControlFuncPtr = &FMCFunctionPtrControl::LocationControl_AccelBased;
+				break;
+			case EMCLocationControlType::Impulse:
+				LocationControlFuncPtr = &FMCFunctionPtrControl::LocationControl_ImpulseBased;
+				break;
+			default:
+				LocationControlFuncPtr = &FMCFunctionPtrControl::LocationControl_VelBased;
+				break;
+			}
+
+			switch (InRotationType)
+			{
+			case EMCRotationControlType::Torque:
+				RotationControlFuncPtr = &FMCFunctionPtrControl::RotationControl_TorqueBased;
+				break;
+			case EMCRotationControlType::Acceleration:
+				RotationControlFuncPtr = &FMCFunctionPtrControl::RotationControl_AccelBased;
+				break;
+			default:
+				RotationControlFuncPtr = &FMCFunctionPtrControl::RotationControl_VelBased;
+				break;
+			}
+		}
+
+		// Read the poses from the components and call the control functions
+		void Update(float DeltaTime)
+		{
+			HandLocation = HandComp->GetComponentLocation();
+			HandQuat = HandComp->GetComponentQuat();
+			TrackingLocation = TrackingComp->GetComponentLocation();
+			TrackingQuat = TrackingComp->GetComponentQuat();
+
+			(this->*LocationControlFuncPtr)(DeltaTime);
+			(this->*RotationControlFuncPtr)(DeltaTime);
+		}
+
+		void LocationControl_ForceBased(float InDeltaTime)
+		{
+			const FVector PIDOut = LocationPIDController.Update(MCLocation - HandLocation, InDeltaTime);
+			HandBodyInstance->AddForce(PIDOut, true);
+		}
+
+		void LocationControl_ImpulseBased(float InDeltaTime)
+		{
+			const FVector PIDOut = LocationPIDController.Update(MCLocation - HandLocation, InDeltaTime);
+			HandBodyInstance->AddImpulse(PIDOut, true);
+		}
+
+		void LocationControl_AccelBased(float InDeltaTime)
+		{
+			const FVector PIDOut = LocationPIDController.Update(MCLocation - HandLocation, InDeltaTime);
+			HandBodyInstance->AddForce(PIDOut, true, true);
+		}
+
+		void LocationControl_VelBased(float InDeltaTime)
+		{
+			const FVector PIDOut = LocationPIDController.Update(MCLocation - HandLocation, InDeltaTime);
+			HandBodyInstance->SetLinearVelocity(PIDOut, false);
+		}
+
+		// Use XYZ from the Quaternion as output, PID P is used as gain
+		FVector GetRotationOutput() const
+		{
+			const FQuat TargetQuat = MCQuat * HandRotationAlignmentOffset;
+			FQuat CompQuat = HandQuat;
+			if ((TargetQuat | CompQuat) < 0.f)
+			{
+				CompQuat *= -1.f;
+			}
+			const FQuat QuatOut = TargetQuat * CompQuat.Inverse();
+			return FVector(QuatOut.X, QuatOut.Y, QuatOut.Z) * RotationP;
+		}
+
+		void RotationControl_TorqueBased(float InDeltaTime)
+		{
+			HandBodyInstance->AddTorqueInRadians(GetRotationOutput(), true);
+		}
+
+		void RotationControl_AccelBased(float InDeltaTime)
+		{
+			HandBodyInstance->AddTorqueInRadians(GetRotationOutput(), true, true);
+		}
+
+		void RotationControl_VelBased(float InDeltaTime)
+		{
+			HandBodyInstance->SetAngularVelocityInRadians(GetRotationOutput(), false);
+		}
+
+		ControlFuncPtrType LocationControlFuncPtr = nullptr;
+		ControlFuncPtrType RotationControlFuncPtr = nullptr;
+		USceneComponent* HandComp = nullptr;
+		USceneComponent* TrackingComp = nullptr;
+		FBodyInstance* HandBodyInstance = nullptr;
+		FPIDController3D LocationPIDController;
+		float RotationP = 0.f;
+		FVector MCLocation = FVector::ZeroVector;
+		FQuat MCQuat = FQuat::Identity;
+		FQuat HandRotationAlignmentOffset = FQuat::Identity;
+		FVector HandLocation = FVector::ZeroVector;
+		FQuat HandQuat = FQuat::Identity;
+		FVector TrackingLocation = FVector::ZeroVector;
+		FQuat TrackingQuat = FQuat::Identity;
+	};
+}
+
+// Constructor, set default values
+UMCControlBenchCommandlet::UMCControlBenchCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = true;
+	LogToConsole = true;
+
+	Iterations = 100000;
+}
+
+// Run the benchmark for every feedback control type combination
+int32 UMCControlBenchCommandlet::Main(const FString& Params)
+{
+	FParse::Value(*Params, TEXT("Iterations="), Iterations);
+	Iterations = FMath::Max(Iterations, 1);
+
+	// Transient world with a physics scene, the hand root body is a simulated sphere
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false);
+	AActor* HandActor = World ? World->SpawnActor<AActor>() : nullptr;
+	if (!HandActor)
+	{
+		UE_LOG(LogTemp, Error, TEXT("[%s] Could not create the benchmark world.."), TEXT(__FUNCTION__));
+		return 1;
+	}
+	USphereComponent* HandComp = NewObject<USphereComponent>(HandActor);
+	HandComp->InitSphereRadius(5.f);
+	HandComp->SetCollisionEnabled(ECollisionEnabled::PhysicsOnly);
+	HandComp->SetSimulatePhysics(true);
+	HandComp->SetEnableGravity(false);
+	HandActor->SetRootComponent(HandComp);
+	HandComp->RegisterComponent();
+
+	FBodyInstance* HandBodyInstance = HandComp->GetBodyInstance();
+	if (!HandBodyInstance || !HandBodyInstance->IsValidBodyInstance())
+	{
+		UE_LOG(LogTemp, Error, TEXT("[%s] Could not create the benchmark body.."), TEXT(__FUNCTION__));
+		World->DestroyWorld(false);
+		return 1;
+	}
+
+	// The controller runs its kernels on the sphere body, it is not registered
+	UMCMovementController6D* Controller = NewObject<UMCMovementController6D>(HandActor);
+	Controller->HandBodyInstance = HandBodyInstance;
+	Controller->MCLocation = FVector(10.f, 5.f, -3.f);
+	Controller->MCQuat = FQuat(FVector::UpVector, 0.5f);
+	Controller->bAllowSubstepping = true;
+
+	FMCFunctionPtrControl FunctionPtrControl;
+	FunctionPtrControl.HandComp = HandComp;
+	FunctionPtrControl.TrackingComp = HandComp;
+	FunctionPtrControl.HandBodyInstance = HandBodyInstance;
+	FunctionPtrControl.MCLocation = Controller->MCLocation;
+	FunctionPtrControl.MCQuat = Controller->MCQuat;
+
+	// Feedback control types only, the teleport based controls do not depend on the dispatch
+	static const EMCLocationControlType LocationTypes[] = {
+		EMCLocationControlType::Force,
+		EMCLocationControlType::Acceleration,
+		EMCLocationControlType::Impulse,
+		EMCLocationControlType::Velocity };
+
+	static const EMCRotationControlType RotationTypes[] = {
+		EMCRotationControlType::Torque,
+		EMCRotationControlType::Acceleration,
+		EMCRotationControlType::Velocity };
+
+	const UEnum* LocEnum = FindObject<UEnum>(ANY_PACKAGE, TEXT("EMCLocationControlType"), true);
+	const UEnum* RotEnum = FindObject<UEnum>(ANY_PACKAGE, TEXT("EMCRotationControlType"), true);
+
+	const float DeltaTime = 1.f / 90.f;
+	const double ToMicroseconds = 1e6 / Iterations;
+	UE_LOG(LogTemp, Display, TEXT("%-14s %-14s %14s %14s"),
+		TEXT("Location"), TEXT("Rotation"), TEXT("FuncPtr us"), TEXT("Kernel us"));
+	for (EMCLocationControlType LocationType : LocationTypes)
+	{
+		for (EMCRotationControlType RotationType : RotationTypes)
+		{
+			FunctionPtrControl.Init(LocationType, RotationType);
+			FunctionPtrControl.LocationPIDController = Controller->LocationPIDController;
+			FunctionPtrControl.LocationPIDController.Init();
+			FunctionPtrControl.RotationP = Controller->RotationPIDController.P;
+
+			double StartTime = FPlatformTime::Seconds();
+			for (int32 Iter = 0; Iter < Iterations; ++Iter)
+			{
+				FunctionPtrControl.Update(DeltaTime);
+			}
+			const double FunctionPtrTime = FPlatformTime::Seconds() - StartTime;
+
+			Controller->LocationControlType = LocationType;
+			Controller->RotationControlType = RotationType;
+			Controller->LocationPIDController.Init();
+			Controller->SelectKernels();
+
+			StartTime = FPlatformTime::Seconds();
+			for (int32 Iter = 0; Iter < Iterations; ++Iter)
+			{
+				(Controller->*Controller->FrameKernel)(DeltaTime);
+			}
+			const double KernelTime = FPlatformTime::Seconds() - StartTime;
+
+			const FString LocName = LocEnum ? LocEnum->GetNameStringByValue(static_cast<int64>(LocationType)) : FString();
+			const FString RotName = RotEnum ? RotEnum->GetNameStringByValue(static_cast<int64>(RotationType)) : FString();
+			UE_LOG(LogTemp, Display, TEXT("%-14s %-14s %14.3f %14.3f"),
+				*LocName, *RotName, FunctionPtrTime * ToMicroseconds, KernelTime * ToMicroseconds);
+		}
+	}
+
+	World->DestroyWorld(false);
+	return 0;
+}
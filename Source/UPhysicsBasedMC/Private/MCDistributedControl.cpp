@@ -0,0 +1,189 @@
+// Copyright 2018, Institute for Artificial Intelligence - University of Bremen
+// Author: Andrei Haidu (http://haidu.eu)
+
+#include "MCDistributedControl.h"
+#include "MCMovementController6D.h"
+#include "MCControlPolicies.h"
+#include "Async/ParallelFor.h"
+#include "AnimationRuntime.h"
+#include "Engine/SkeletalMesh.h"
+
+// Collect the bodies of the hand and their reference pose offsets relative to the root body,
+// the bodies of the excluded bones (e.g. fingers driven by the grasp controller) are not controlled
+void FMCDistributedControl::Init(USkeletalMeshComponent* InHand, const TMap<FName, float>& InBoneGainMultipliers,
+	const TArray<int32>& InExcludedBoneIndices)
+{
+	Bodies.Empty();
+	BoneNames.Empty();
+	BodyToRootOffsets.Empty();
+	MassFractions.Empty();
+	GainMultipliers.Empty();
+	TotalMass = 0.f;
+
+	FBodyInstance* RootBody = InHand ? InHand->GetBodyInstance() : nullptr;
+	if (!RootBody || !InHand->SkeletalMesh)
+	{
+		return;
+	}
+
+	// Offsets from the reference pose, not from the current pose of the bodies
+	const FReferenceSkeleton& RefSkeleton = InHand->SkeletalMesh->RefSkeleton;
+	const FTransform RootTransform = FAnimationRuntime::GetComponentSpaceTransformRefPose(RefSkeleton, RootBody->InstanceBoneIndex);
+
+	// Root body first, the rest in the order of the physics asset
+	Bodies.Add(RootBody);
+	for (FBodyInstance* Body : InHand->Bodies)
+	{
+		if (Body && Body != RootBody && Body->IsInstanceSimulatingPhysics()
+			&& !InExcludedBoneIndices.Contains(Body->InstanceBoneIndex))
+		{
+			Bodies.Add(Body);
+		}
+	}
+
+	for (FBodyInstance* Body : Bodies)
+	{
+		const FName BoneName = InHand->GetBoneName(Body->InstanceBoneIndex);
+		const float* Multiplier = InBoneGainMultipliers.Find(BoneName);
+		const float BodyMass = Body->GetBodyMass();
+
+		BoneNames.Add(BoneName);
+		BodyToRootOffsets.Add(FAnimationRuntime::GetComponentSpaceTransformRefPose(RefSkeleton, Body->InstanceBoneIndex)
+			.GetRelativeTransform(RootTransform));
+		MassFractions.Add(BodyMass);
+		GainMultipliers.Add(Multiplier ? *Multiplier : 1.f);
+		TotalMass += BodyMass;
+	}
+
+	for (float& MassFraction : MassFractions)
+	{
+		MassFraction = TotalMass > SMALL_NUMBER ? MassFraction / TotalMass : 1.f / MassFractions.Num();
+	}
+
+	const int32 NumBodies = Bodies.Num();
+	Transforms.Init(FTransform::Identity, NumBodies);
+	AngularVelocities.Init(FVector::ZeroVector, NumBodies);
+	LocationPrevErrors.Init(FVector::ZeroVector, NumBodies);
+	LocationIntegrals.Init(FVector::ZeroVector, NumBodies);
+	RotationIntegrals.Init(FVector::ZeroVector, NumBodies);
+	LocationOutputs.Init(FVector::ZeroVector, NumBodies);
+	RotationOutputs.Init(FVector::ZeroVector, NumBodies);
+}
+
+// Refresh the body pointers if the physics state of the hand has been recreated
+void FMCDistributedControl::RefreshBodies(USkeletalMeshComponent* InHand)
+{
+	if (Bodies.Num() == 0 || Bodies[0] == InHand->GetBodyInstance())
+	{
+		return;
+	}
+
+	for (int32 Idx = 0; Idx < Bodies.Num(); ++Idx)
+	{
+		Bodies[Idx] = Idx == 0 ? InHand->GetBodyInstance() : InHand->GetBodyInstance(BoneNames[Idx]);
+	}
+}
+
+// Read the poses of all the bodies (physics scene has to be locked)
+void FMCDistributedControl::ReadBodyPoses_AssumesLocked(bool bReadAngularVelocities)
+{
+	for (int32 Idx = 0; Idx < Bodies.Num(); ++Idx)
+	{
+		if (FBodyInstance* Body = Bodies[Idx])
+		{
+			Transforms[Idx] = Body->GetUnrealWorldTransform_AssumesLocked();
+			if (bReadAngularVelocities)
+			{
+				AngularVelocities[Idx] = Body->GetUnrealWorldAngularVelocityInRadians_AssumesLocked();
+			}
+		}
+	}
+}
+
+// Compute the outputs of all the bones from the target of the root body
+void FMCDistributedControl::Evaluate(const FTransform& InRootTarget, float P, float I, float D, float MaxOutAbs,
+	bool bRotationPID, float RotP, float RotI, float RotD, float RotMaxOutAbs, float DeltaTime)
+{
+	if (DeltaTime <= 0.f)
+	{
+		return;
+	}
+	const float InvDeltaTime = 1.f / DeltaTime;
+
+	ParallelFor(Bodies.Num(), [&](int32 Idx)
+	{
+		const FTransform Target = BodyToRootOffsets[Idx] * InRootTarget;
+		const float Gain = GainMultipliers[Idx];
+
+		// Location PID
+		const FVector LocErr = Target.GetLocation() - Transforms[Idx].GetLocation();
+		LocationIntegrals[Idx] += LocErr * DeltaTime;
+		const FVector LocDErr = (LocErr - LocationPrevErrors[Idx]) * InvDeltaTime;
+		LocationPrevErrors[Idx] = LocErr;
+		LocationOutputs[Idx] = ((LocErr * P + LocationIntegrals[Idx] * I + LocDErr * D) * Gain).BoundToCube(MaxOutAbs);
+
+		// Rotation
+		if (bRotationPID)
+		{
+			RotationOutputs[Idx] = MCRotationPIDUpdate(RotationIntegrals[Idx],
+				MCRotationErrorAxisAngle(Target.GetRotation(), Transforms[Idx].GetRotation()), AngularVelocities[Idx],
+				DeltaTime, RotP * Gain, RotI * Gain, RotD * Gain, RotMaxOutAbs);
+		}
+		else
+		{
+			RotationOutputs[Idx] = MCRotationError(Target.GetRotation(), Transforms[Idx].GetRotation()) * RotP * Gain;
+		}
+	});
+}
+
+// Apply the outputs to all the bodies, forces and torques are mass weighted (physics scene has to be locked)
+void FMCDistributedControl::WriteOutputs_AssumesLocked(EMCLocationControlType InLocationType, EMCRotationControlType InRotationType,
+	const FVector& InLocationFeedForward, bool bAllowSubstepping)
+{
+	for (int32 Idx = 0; Idx < Bodies.Num(); ++Idx)
+	{
+		FBodyInstance* Body = Bodies[Idx];
+		if (!Body)
+		{
+			continue;
+		}
+
+		// Forces and torques are split by the mass share of the bodies, the hand sums up to the root body output
+		const FVector LocationOut = LocationOutputs[Idx] + InLocationFeedForward;
+		switch (InLocationType)
+		{
+		case EMCLocationControlType::Force:
+			FMCLocationControlForce::Apply_AssumesLocked(*Body, LocationOut * MassFractions[Idx], bAllowSubstepping);
+			break;
+		case EMCLocationControlType::Acceleration:
+			FMCLocationControlAcceleration::Apply_AssumesLocked(*Body, LocationOut, bAllowSubstepping);
+			break;
+		case EMCLocationControlType::Impulse:
+			FMCLocationControlImpulse::Apply_AssumesLocked(*Body, LocationOut, bAllowSubstepping);
+			break;
+		case EMCLocationControlType::Velocity:
+			FMCLocationControlVelocity::Apply_AssumesLocked(*Body, LocationOut, bAllowSubstepping);
+			break;
+		default:
+			break;
+		}
+
+		switch (InRotationType)
+		{
+		case EMCRotationControlType::Torque:
+			FMCRotationControlTorque::Apply_AssumesLocked(*Body, RotationOutputs[Idx] * MassFractions[Idx], bAllowSubstepping);
+			break;
+		case EMCRotationControlType::Acceleration:
+			FMCRotationControlAcceleration::Apply_AssumesLocked(*Body, RotationOutputs[Idx], bAllowSubstepping);
+			break;
+		case EMCRotationControlType::Impulse:
+			FMCRotationControlImpulse::Apply_AssumesLocked(*Body, RotationOutputs[Idx], bAllowSubstepping);
+			break;
+		case EMCRotationControlType::Velocity:
+			FMCRotationControlVelocity::Apply_AssumesLocked(*Body, RotationOutputs[Idx], bAllowSubstepping);
+			break;
+		default:
+			break;
+		}
+	}
+}
@@ -5,10 +5,15 @@
 #include "Kismet/GameplayStatics.h"
 #include "EngineUtils.h"
 #include "XRMotionControllerBase.h"
+#include "UPhysicsBasedMC.h"
 #if WITH_SEMLOG
 #include "SLGraspTrigger.h"
 #endif // WITH_SEMLOG
 
+DECLARE_CYCLE_STAT(TEXT("Fixation Grab (Attach)"), STAT_MCFixationAttach, STATGROUP_PhysicsBasedMC);
+DECLARE_CYCLE_STAT(TEXT("Fixation Release (Attach)"), STAT_MCFixationDetach, STATGROUP_PhysicsBasedMC);
+DECLARE_CYCLE_STAT(TEXT("Fixation Grab (Constraint)"), STAT_MCFixationConstrain, STATGROUP_PhysicsBasedMC);
+DECLARE_CYCLE_STAT(TEXT("Fixation Release (Constraint)"), STAT_MCFixationUnconstrain, STATGROUP_PhysicsBasedMC);
 
 // Constructor, set default values
 UMCFixationGraspController::UMCFixationGraspController()
@@ -18,6 +23,33 @@ UMCFixationGraspController::UMCFixationGraspController()
 	bWeldFixation = true;
 	ObjectMaxLength = 50.f;
 	ObjectMaxMass = 15.f;
+
+	// Track the objects in reach with overlap events by default
+	bUseGraspabilityRegistry = false;
+	bOverlapQuery = false;
+	bIndexedQuery = false;
+	bAsyncOverlapQuery = false;
+	GraspDirection = FVector::ForwardVector;
+	AlignmentWeight = 0.5f;
+	bFixationRequested = false;
+	GraspabilityRegistry = nullptr;
+
+	// Attach the fixated objects by default
+	bConstraintFixation = false;
+	ConstraintPoolSize = 2;
+	FixationConstraintIdx = INDEX_NONE;
+
+	// Only fixate on input by default
+	bAutoFixation = false;
+	AutoFixationFrames = 10;
+	AutoFixationMaxRelativeSpeed = 5.f;
+	AutoFixationMinGraspValue = 0.1f;
+	AutoDetachOpening = 0.3f;
+	GraspController = nullptr;
+	StableGraspCandidate = nullptr;
+	StableGraspFrames = 0;
+	AutoFixationGraspValue = 0.f;
+	bAutoFixated = false;
 }
 
 // Called when the game starts or when spawned
@@ -39,6 +71,8 @@ void UMCFixationGraspController::EndPlay(const EEndPlayReason::Type EndPlayReaso
 	}
 #endif //WITH_SEMLOG
 
+	// Break the constraint of a still fixated object
+	ReleaseConstraint();
 }
 
 // Init fixation grasp	
@@ -75,9 +109,30 @@ void UMCFixationGraspController::Init(USkeletalMeshComponent* InHand, UMotionCon
 		}
 	}
 	
-	// Bind overlap events
-	OnComponentBeginOverlap.AddDynamic(this, &UMCFixationGraspController::OnFixationGraspAreaBeginOverlap);
-	OnComponentEndOverlap.AddDynamic(this, &UMCFixationGraspController::OnFixationGraspAreaEndOverlap);
+	// The registry is only spawned (and built) on request or for the indexed query, an existing one also caches the graspability checks
+	GraspabilityRegistry = bUseGraspabilityRegistry || (bOverlapQuery && bIndexedQuery)
+		? AMCGraspabilityRegistry::GetInstance(GetWorld())
+		: AMCGraspabilityRegistry::FindInstance(GetWorld());
+
+	// Constraints are set up once, fixating only connects the bodies
+	if (bConstraintFixation)
+	{
+		SetupConstraintPool();
+	}
+
+	if (bOverlapQuery)
+	{
+		// No overlap events and no shape in the physics scene, the objects in reach are queried on demand
+		SetGenerateOverlapEvents(false);
+		SetCollisionEnabled(ECollisionEnabled::NoCollision);
+		OverlapQueryDelegate.BindUObject(this, &UMCFixationGraspController::OnFixationOverlapQueryDone);
+	}
+	else
+	{
+		// Bind overlap events
+		OnComponentBeginOverlap.AddDynamic(this, &UMCFixationGraspController::OnFixationGraspAreaBeginOverlap);
+		OnComponentEndOverlap.AddDynamic(this, &UMCFixationGraspController::OnFixationGraspAreaEndOverlap);
+	}
 }
 
 // Setup input bindings
@@ -99,6 +154,12 @@ void UMCFixationGraspController::SetupInputBindings(UMotionControllerComponent*
 // Try to fixate object to hand
 void UMCFixationGraspController::TryToFixate()
 {
+	if (bOverlapQuery)
+	{
+		QueryAndFixate();
+		return;
+	}
+
 	while (!FixatedObject && ObjectsInReach.Num() > 0)
 	{
 		// Pop a SMA
@@ -115,20 +176,40 @@ void UMCFixationGraspController::TryToFixate()
 // Fixate object to hand
 void UMCFixationGraspController::FixateObject(AStaticMeshActor* InSMA)
 {
-	// Disable physics and overlap events
-	UStaticMeshComponent* SMC = InSMA->GetStaticMeshComponent();
-	SMC->SetSimulatePhysics(false);
-	//SMC->bGenerateOverlapEvents = false; // We want the object to continue to generate overlap events (e.g. semantic contacts)
-	
-	InSMA->AttachToComponent(SkeletalHand, FAttachmentTransformRules(
-	EAttachmentRule::KeepWorld, EAttachmentRule::KeepWorld, EAttachmentRule::KeepWorld, bWeldFixation));
-	//SMC->AttachToComponent(SkeletalHand, FAttachmentTransformRules(
-	//	EAttachmentRule::KeepWorld, EAttachmentRule::KeepWorld, EAttachmentRule::KeepWorld, bWeldFixation));
-	//InSMA->AttachToActor(SkeletalHand, FAttachmentTransformRules(
-	//	EAttachmentRule::KeepWorld, EAttachmentRule::KeepWorld, EAttachmentRule::KeepWorld, bWeldFixation));
+	if (bConstraintFixation)
+	{
+		// The object keeps simulating, no physics state is recreated
+		if (!ConstrainObject(InSMA))
+		{
+			return;
+		}
+	}
+	else
+	{
+		SCOPE_CYCLE_COUNTER(STAT_MCFixationAttach);
+
+		// Disable physics and overlap events
+		UStaticMeshComponent* SMC = InSMA->GetStaticMeshComponent();
+		SMC->SetSimulatePhysics(false);
+		if (GraspabilityRegistry)
+		{
+			GraspabilityRegistry->Invalidate(InSMA);
+		}
+		//SMC->bGenerateOverlapEvents = false; // We want the object to continue to generate overlap events (e.g. semantic contacts)
+
+		InSMA->AttachToComponent(SkeletalHand, FAttachmentTransformRules(
+			EAttachmentRule::KeepWorld, EAttachmentRule::KeepWorld, EAttachmentRule::KeepWorld, bWeldFixation));
+		//SMC->AttachToComponent(SkeletalHand, FAttachmentTransformRules(
+		//	EAttachmentRule::KeepWorld, EAttachmentRule::KeepWorld, EAttachmentRule::KeepWorld, bWeldFixation));
+		//InSMA->AttachToActor(SkeletalHand, FAttachmentTransformRules(
+		//	EAttachmentRule::KeepWorld, EAttachmentRule::KeepWorld, EAttachmentRule::KeepWorld, bWeldFixation));
+	}
 
 	// Disable overlap checks during fixation grasp
-	SetGenerateOverlapEvents(false);
+	if (!bOverlapQuery)
+	{
+		SetGenerateOverlapEvents(false);
+	}
 
 	// Set the fixated object
 	FixatedObject = InSMA;
@@ -149,24 +230,44 @@ void UMCFixationGraspController::FixateObject(AStaticMeshActor* InSMA)
 // Detach fixation
 void UMCFixationGraspController::TryToDetach()
 {
+	// A pending async query is not used anymore
+	bFixationRequested = false;
+
 	if (FixatedObject)
 	{
-		// Get current velocity before detachment (gets reseted)
-		const FVector CurrVel = FixatedObject->GetVelocity();
+		if (FixationConstraintIdx != INDEX_NONE)
+		{
+			// The object is still simulated and moves with its current velocity
+			ReleaseConstraint();
+		}
+		else
+		{
+			SCOPE_CYCLE_COUNTER(STAT_MCFixationDetach);
+
+			// Get current velocity before detachment (gets reseted)
+			const FVector CurrVel = FixatedObject->GetVelocity();
 
-		// Detach object from hand
-		UStaticMeshComponent* SMC = FixatedObject->GetStaticMeshComponent();
-		SMC->DetachFromComponent(FDetachmentTransformRules(
-			EDetachmentRule::KeepWorld, EDetachmentRule::KeepWorld, EDetachmentRule::KeepWorld, true));
+			// Detach object from hand
+			UStaticMeshComponent* SMC = FixatedObject->GetStaticMeshComponent();
+			SMC->DetachFromComponent(FDetachmentTransformRules(
+				EDetachmentRule::KeepWorld, EDetachmentRule::KeepWorld, EDetachmentRule::KeepWorld, true));
 
-		// Enable physics with and apply current hand velocity, clear pointer to object
-		SMC->SetSimulatePhysics(true);
-		SMC->SetGenerateOverlapEvents(true);
-		SMC->SetPhysicsLinearVelocity(CurrVel);
+			// Enable physics with and apply current hand velocity, clear pointer to object
+			SMC->SetSimulatePhysics(true);
+			if (GraspabilityRegistry)
+			{
+				GraspabilityRegistry->Invalidate(FixatedObject);
+			}
+			SMC->SetGenerateOverlapEvents(true);
+			SMC->SetPhysicsLinearVelocity(CurrVel);
+		}
 				
 		// Enable and update overlaps
-		SetGenerateOverlapEvents(true);
-		UpdateOverlaps();
+		if (!bOverlapQuery)
+		{
+			SetGenerateOverlapEvents(true);
+			UpdateOverlaps();
+		}
 
 #if WITH_SEMLOG
 	UE_LOG(LogTemp, Warning, TEXT(">> %s::%d"), TEXT(__FUNCTION__), __LINE__);
@@ -179,12 +280,244 @@ void UMCFixationGraspController::TryToDetach()
 
 		// Clear fixate object reference
 		FixatedObject = nullptr;
+
+		// Let the finger contacts update again
+		if (bAutoFixated)
+		{
+			bAutoFixated = false;
+			GraspController->HoldFingerContacts(false);
+		}
+	}
+}
+
+// Query the objects in reach, fixate the best ranked graspable one
+void UMCFixationGraspController::QueryAndFixate()
+{
+	if (FixatedObject)
+	{
+		return;
+	}
+
+	// No physics scene query, the graspable objects are looked up in the spatial hash
+	if (bIndexedQuery && GraspabilityRegistry)
+	{
+		TArray<AStaticMeshActor*> Candidates;
+		GraspabilityRegistry->FindInRadius(GetComponentLocation(), GetScaledSphereRadius(), Candidates);
+		FixateBestCandidate(Candidates);
+		return;
+	}
+
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(MCFixationOverlap), false, GetOwner());
+	const FCollisionObjectQueryParams ObjectParams(FCollisionObjectQueryParams::AllDynamicObjects);
+	const FCollisionShape Sphere = FCollisionShape::MakeSphere(GetScaledSphereRadius());
+	if (bAsyncOverlapQuery)
+	{
+		bFixationRequested = true;
+		GetWorld()->AsyncOverlapByObjectType(GetComponentLocation(), FQuat::Identity, ObjectParams, Sphere,
+			QueryParams, &OverlapQueryDelegate);
+	}
+	else
+	{
+		TArray<FOverlapResult> Overlaps;
+		GetWorld()->OverlapMultiByObjectType(Overlaps, GetComponentLocation(), FQuat::Identity, ObjectParams, Sphere, QueryParams);
+		FixateBestCandidate(Overlaps);
+	}
+}
+
+// Fixate the best ranked graspable object of the overlaps
+void UMCFixationGraspController::FixateBestCandidate(const TArray<FOverlapResult>& InOverlaps)
+{
+	TArray<AStaticMeshActor*> OverlapActors;
+	for (const FOverlapResult& Overlap : InOverlaps)
+	{
+		if (AStaticMeshActor* SMA = Cast<AStaticMeshActor>(Overlap.GetActor()))
+		{
+			OverlapActors.AddUnique(SMA);
+		}
+	}
+	FixateBestCandidate(OverlapActors);
+}
+
+// Fixate the best ranked graspable object of the candidates
+void UMCFixationGraspController::FixateBestCandidate(const TArray<AStaticMeshActor*>& InCandidates)
+{
+	// Rank by the distance relative to the reach and by the alignment with the grasp direction, lower is better
+	const FVector Location = GetComponentLocation();
+	const FVector Direction = GetComponentQuat().RotateVector(GraspDirection.GetSafeNormal());
+	const float InvRadius = 1.f / FMath::Max(GetScaledSphereRadius(), KINDA_SMALL_NUMBER);
+	TArray<TPair<float, AStaticMeshActor*>, TInlineAllocator<8>> Candidates;
+	for (AStaticMeshActor* SMA : InCandidates)
+	{
+		const FVector ToObject = SMA->GetActorLocation() - Location;
+		const float Score = ToObject.Size() * InvRadius - AlignmentWeight * (ToObject.GetSafeNormal() | Direction);
+		Candidates.Emplace(Score, SMA);
+	}
+	Candidates.Sort([](const TPair<float, AStaticMeshActor*>& A, const TPair<float, AStaticMeshActor*>& B) { return A.Key < B.Key; });
+
+	for (const TPair<float, AStaticMeshActor*>& Candidate : Candidates)
+	{
+		if (CanBeGrasped(Candidate.Value))
+		{
+			FixateObject(Candidate.Value);
+			if (FixatedObject)
+			{
+				return;
+			}
+		}
+	}
+}
+
+// Async overlap query callback
+void UMCFixationGraspController::OnFixationOverlapQueryDone(const FTraceHandle& InTraceHandle, FOverlapDatum& InOverlapDatum)
+{
+	// The input has been released in the meantime
+	if (!bFixationRequested || FixatedObject)
+	{
+		return;
+	}
+	bFixationRequested = false;
+	FixateBestCandidate(InOverlapDatum.OutOverlaps);
+}
+
+// Weld the objects stably held by the fingers of the grasp controller
+void UMCFixationGraspController::SetupAutoFixation(UMCGraspController* InGraspController)
+{
+	if (!InGraspController->bContactAwareGrasp)
+	{
+		UE_LOG(LogTemp, Error, TEXT("[%s] Automatic fixation requires the contact aware grasp, disabling it.."),
+			*FString(__FUNCTION__));
+		bAutoFixation = false;
+		return;
 	}
+	GraspController = InGraspController;
+}
+
+// Fixate stable grasps, detach them when the hand opens (game thread)
+void UMCFixationGraspController::UpdateAutoFixation()
+{
+	if (!GraspController)
+	{
+		return;
+	}
+
+	// Welded objects stay fixated until the hand opens
+	if (FixatedObject)
+	{
+		if (bAutoFixated && GraspController->GetGraspValue() < AutoFixationGraspValue * (1.f - AutoDetachOpening))
+		{
+			TryToDetach();
+		}
+		return;
+	}
+
+	// The object has to be held by opposing fingers and move with the hand
+	AStaticMeshActor* SMA = Cast<AStaticMeshActor>(GraspController->GetOpposingContactActor());
+	const bool bStable = SMA && GraspController->GetGraspValue() >= AutoFixationMinGraspValue && CanBeGrasped(SMA)
+		&& (SMA->GetStaticMeshComponent()->GetPhysicsLinearVelocity() - SkeletalHand->GetPhysicsLinearVelocity()).Size()
+			< AutoFixationMaxRelativeSpeed;
+	if (!bStable)
+	{
+		StableGraspCandidate = nullptr;
+		StableGraspFrames = 0;
+		return;
+	}
+
+	if (SMA != StableGraspCandidate)
+	{
+		StableGraspCandidate = SMA;
+		StableGraspFrames = 0;
+	}
+
+	if (++StableGraspFrames >= AutoFixationFrames)
+	{
+		// Fixation can fail (e.g. no free constraint), the candidate is then retried after the next stable frames
+		FixateObject(SMA);
+		if (FixatedObject)
+		{
+			// The welded object does not report finger contacts anymore, keep the current ones
+			GraspController->HoldFingerContacts(true);
+			AutoFixationGraspValue = GraspController->GetGraspValue();
+			bAutoFixated = true;
+		}
+		StableGraspCandidate = nullptr;
+		StableGraspFrames = 0;
+	}
+}
+
+// Setup the stiff constraints of the pool
+void UMCFixationGraspController::SetupConstraintPool()
+{
+	ConstraintPool.SetNum(ConstraintPoolSize);
+	FreeConstraints.Empty(ConstraintPoolSize);
+	for (int32 Idx = ConstraintPool.Num() - 1; Idx >= 0; --Idx)
+	{
+		// All the degrees of freedom are locked, no collision between the hand and the object
+		FConstraintInstance& Constraint = ConstraintPool[Idx];
+		Constraint.SetLinearXLimit(ELinearConstraintMotion::LCM_Locked, 0.f);
+		Constraint.SetLinearYLimit(ELinearConstraintMotion::LCM_Locked, 0.f);
+		Constraint.SetLinearZLimit(ELinearConstraintMotion::LCM_Locked, 0.f);
+		Constraint.SetAngularSwing1Limit(EAngularConstraintMotion::ACM_Locked, 0.f);
+		Constraint.SetAngularSwing2Limit(EAngularConstraintMotion::ACM_Locked, 0.f);
+		Constraint.SetAngularTwistLimit(EAngularConstraintMotion::ACM_Locked, 0.f);
+		Constraint.ProfileInstance.bDisableCollision = true;
+		Constraint.ProfileInstance.bEnableProjection = true;
+		FreeConstraints.Push(Idx);
+	}
+}
+
+// Connect the object to the hand with a pooled constraint, the object keeps simulating
+bool UMCFixationGraspController::ConstrainObject(AStaticMeshActor* InSMA)
+{
+	SCOPE_CYCLE_COUNTER(STAT_MCFixationConstrain);
+
+	FBodyInstance* HandBody = SkeletalHand->GetBodyInstance();
+	FBodyInstance* ObjectBody = InSMA->GetStaticMeshComponent()->GetBodyInstance();
+	if (!HandBody || !ObjectBody || FreeConstraints.Num() == 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("[%s] No free constraint or no bodies to connect.."), *FString(__FUNCTION__));
+		return false;
+	}
+
+	// The object frame is kept in its current pose relative to the hand
+	FConstraintInstance& Constraint = ConstraintPool[FreeConstraints.Last()];
+	FTransform ObjectInHand = ObjectBody->GetUnrealWorldTransform().GetRelativeTransform(HandBody->GetUnrealWorldTransform());
+	ObjectInHand.RemoveScaling();
+	Constraint.SetRefFrame(EConstraintFrame::Frame1, FTransform::Identity);
+	Constraint.SetRefFrame(EConstraintFrame::Frame2, ObjectInHand);
+	Constraint.InitConstraint(ObjectBody, HandBody, 1.f, this);
+	if (!Constraint.IsValidConstraintInstance())
+	{
+		UE_LOG(LogTemp, Error, TEXT("[%s] Could not create the fixation constraint.."), *FString(__FUNCTION__));
+		return false;
+	}
+
+	FixationConstraintIdx = FreeConstraints.Pop(false);
+	return true;
+}
+
+// Break the constraint of the fixated object and return it to the pool
+void UMCFixationGraspController::ReleaseConstraint()
+{
+	if (FixationConstraintIdx == INDEX_NONE)
+	{
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_MCFixationUnconstrain);
+	ConstraintPool[FixationConstraintIdx].TermConstraint();
+	FreeConstraints.Push(FixationConstraintIdx);
+	FixationConstraintIdx = INDEX_NONE;
 }
 
 // Check if object is graspable
 bool UMCFixationGraspController::CanBeGrasped(AStaticMeshActor* InSMA)
 {
+	// Cached mobility, simulation state, mass and bounds
+	if (GraspabilityRegistry)
+	{
+		return GraspabilityRegistry->CanBeGrasped(InSMA, ObjectMaxMass, ObjectMaxLength);
+	}
+
 	// Check if the object is movable
 	if (!InSMA->IsRootComponentMovable())
 	{
@@ -3,6 +3,13 @@
 
 #include "MCGraspController.h"
 #include "PhysicsEngine/ConstraintInstance.h"
+#include "PhysicsPublic.h"
+#include "Physics/PhysicsInterfaceCore.h"
+#include "UPhysicsBasedMC.h"
+#include "MCSkeletonIndexMap.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Finger Drive Writes"), STAT_MCFingerDriveWrites, STATGROUP_PhysicsBasedMC);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Finger Body Wake Ups"), STAT_MCFingerBodyWakeUps, STATGROUP_PhysicsBasedMC);
 
 // Constructor
 UMCGraspController::UMCGraspController()
@@ -13,6 +20,24 @@ UMCGraspController::UMCGraspController()
 	Damping = 100.0f;
 	ForceLimit = 900000.0f;
 	UpdateMultiplier = 100.f;
+	UpdateEpsilon = 0.001f;
+
+	// Trigger values are positive, forces the first update
+	LastUpdateValue = -1.f;
+	LastInputValue = 0.f;
+
+	GraspStyle = EGraspStyle::PowerSphere;
+	ActiveGraspPose = nullptr;
+
+	// Grasp axis input by default
+	bUseJointInput = false;
+	JointInputSlot = MakeUnique<FMCJointInputSlot>();
+
+	// Fingers close regardless of contacts by default
+	bContactAwareGrasp = false;
+	ContactStableFrames = 3;
+	ContactDriveScale = 0.1f;
+	bHoldContacts = false;
 }
 
 // Init grasp controller
@@ -45,11 +70,70 @@ void UMCGraspController::Init(USkeletalMeshComponent* InHand, EControllerHand In
 
 	// Setup fingers
 	SetupFingers();
+
+	// Report the contacts of the finger bodies
+	if (bContactAwareGrasp)
+	{
+		for (FBodyInstance* FingerBody : FingerBodies)
+		{
+			if (FingerBody)
+			{
+				FingerBody->SetInstanceNotifyRBCollision(true);
+			}
+		}
+		SkeletalHand->OnComponentHit.AddDynamic(this, &UMCGraspController::OnFingerHit);
+	}
+
+	// Select the joint targets of the grasp style
+	SetGraspStyle(GraspStyle);
+}
+
+// Switch the grasp style, the fingers move to the new pose with the current input
+void UMCGraspController::SetGraspStyle(EGraspStyle InGraspStyle)
+{
+	GraspStyle = InGraspStyle;
+
+	// The baked tables are shared by every hand using the same asset
+	UMCGraspPose* const* GraspPose = GraspPoses.Find(GraspStyle);
+	ActiveGraspPose = GraspPose ? *GraspPose : nullptr;
+	if (ActiveGraspPose)
+	{
+		ActiveGraspPose->Bake();
+	}
+	else if (GraspStyle != EGraspStyle::PowerSphere)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[%s] No grasp pose asset for the grasp style, using the uniform finger roll.."),
+			*FString(__FUNCTION__));
+	}
+
+	// Apply the current input with the new style
+	if (bUseJointInput)
+	{
+		for (float& LastJointValue : LastJointValues)
+		{
+			LastJointValue = -1.f;
+		}
+		if (ApplyJointInput(LatestJointInput))
+		{
+			WriteDriveTargets();
+		}
+	}
+	else
+	{
+		LastUpdateValue = -1.f;
+		Update(LastInputValue);
+	}
 }
 
 // Setup input bindings
 void UMCGraspController::SetupInputBindings(UInputComponent* InIC)
 {	
+	// The device input is pushed directly, the grasp axis is not needed
+	if (bUseJointInput)
+	{
+		return;
+	}
+
 	// Check hand type
 	if (HandType == EControllerHand::Left)
 	{
@@ -64,47 +148,30 @@ void UMCGraspController::SetupInputBindings(UInputComponent* InIC)
 // Setup fingers
 void UMCGraspController::SetupFingers()
 {
-	// Local struct for storing bone names and their bone type
-	struct FBoneNameAndType
-	{
-		FBoneNameAndType(FMCFingerBone* InFingerBone, const FString& InBoneName/*, EFingerBone InBoneType*/) :
-			FingerBone(InFingerBone), BoneName(InBoneName)/*, BoneType(InBoneType)*/{};
-		FMCFingerBone* FingerBone;
-		FString BoneName;
-		/*EFingerBone BoneType;*/
-	};
-	// Array of the bone names and their types
-	TArray<FBoneNameAndType> BonesAndTypes;
-	
-	// Set the postfix of hand type
-	const FString HandTypePostfix = HandType == EControllerHand::Left ? FString("l") : FString("r");
-
-	BonesAndTypes.Add(FBoneNameAndType(&Thumb.Distal, FString("thumb_03_").Append(HandTypePostfix)/*, EFingerBone::Distal*/));
-	BonesAndTypes.Add(FBoneNameAndType(&Thumb.Intermediate, FString("thumb_02_").Append(HandTypePostfix)/*, EFingerBone::Intermediate*/));
-	BonesAndTypes.Add(FBoneNameAndType(&Thumb.Proximal, FString("thumb_01_").Append(HandTypePostfix)/*, EFingerBone::Proximal*/));
+	// Finger bones in the order of the grasp pose joints
+	FMCFingerBone* const FingerBones[] = {
+		&Thumb.Distal, &Thumb.Intermediate, &Thumb.Proximal,
+		&Index.Distal, &Index.Intermediate, &Index.Proximal,
+		&Middle.Distal, &Middle.Intermediate, &Middle.Proximal,
+		&Ring.Distal, &Ring.Intermediate, &Ring.Proximal,
+		&Pinky.Distal, &Pinky.Intermediate, &Pinky.Proximal };
+	const TArray<FString>& JointNames = UMCGraspPose::GetJointNames();
+	check(JointNames.Num() == ARRAY_COUNT(FingerBones));
 
-	BonesAndTypes.Add(FBoneNameAndType(&Index.Distal, FString("index_03_").Append(HandTypePostfix)/*, EFingerBone::Distal*/));
-	BonesAndTypes.Add(FBoneNameAndType(&Index.Intermediate, FString("index_02_").Append(HandTypePostfix)/*, EFingerBone::Intermediate*/));
-	BonesAndTypes.Add(FBoneNameAndType(&Index.Proximal, FString("index_01_").Append(HandTypePostfix)/*, EFingerBone::Proximal*/));
+	// Bone and constraint indices shared by all the hands with the same mesh
+	SkeletonIndexMap = FMCSkeletonIndexMap::Get(SkeletalHand);
 
-	BonesAndTypes.Add(FBoneNameAndType(&Middle.Distal, FString("middle_03_").Append(HandTypePostfix)/*, EFingerBone::Distal*/));
-	BonesAndTypes.Add(FBoneNameAndType(&Middle.Intermediate, FString("middle_02_").Append(HandTypePostfix)/*, EFingerBone::Intermediate*/));
-	BonesAndTypes.Add(FBoneNameAndType(&Middle.Proximal, FString("middle_01_").Append(HandTypePostfix)/*, EFingerBone::Proximal*/));
+	// Set the postfix of hand type (default bone names)
+	const FString HandTypePostfix = HandType == EControllerHand::Left ? FString("_l") : FString("_r");
 
-	BonesAndTypes.Add(FBoneNameAndType(&Ring.Distal, FString("ring_03_").Append(HandTypePostfix)/*, EFingerBone::Distal*/));
-	BonesAndTypes.Add(FBoneNameAndType(&Ring.Intermediate, FString("ring_02_").Append(HandTypePostfix)/*, EFingerBone::Intermediate*/));
-	BonesAndTypes.Add(FBoneNameAndType(&Ring.Proximal, FString("ring_01_").Append(HandTypePostfix)/*, EFingerBone::Proximal*/));
-
-	BonesAndTypes.Add(FBoneNameAndType(&Pinky.Distal, FString("pinky_03_").Append(HandTypePostfix)/*, EFingerBone::Distal*/));
-	BonesAndTypes.Add(FBoneNameAndType(&Pinky.Intermediate, FString("pinky_02_").Append(HandTypePostfix)/*, EFingerBone::Intermediate*/));
-	BonesAndTypes.Add(FBoneNameAndType(&Pinky.Proximal, FString("pinky_01_").Append(HandTypePostfix)/*, EFingerBone::Proximal*/));
-
-	// Iterate array and setup fingers
-	for (auto& BoneAndTypeItr : BonesAndTypes)
+	// Iterate the joints and setup fingers
+	for (int32 JointIdx = 0; JointIdx < JointNames.Num(); ++JointIdx)
 	{
-		if (FConstraintInstance* FingerConstraint = GetFingerConstraint(BoneAndTypeItr.BoneName))
+		const FName* MappedBoneName = BoneNameMapping.Find(JointNames[JointIdx]);
+		const FName BoneName = MappedBoneName ? *MappedBoneName : FName(*(JointNames[JointIdx] + HandTypePostfix));
+		if (FConstraintInstance* FingerConstraint = GetFingerConstraint(BoneName))
 		{
-			BoneAndTypeItr.FingerBone->Init(/*BoneAndTypeItr.BoneType, */BoneAndTypeItr.BoneName, FingerConstraint);
+			FingerBones[JointIdx]->Init(/*BoneType, */BoneName.ToString(), FingerConstraint);
 
 			FingerConstraint->SetAngularDriveMode(AngularDriveMode);
 			if (AngularDriveMode == EAngularDriveMode::TwistAndSwing)
@@ -116,42 +183,299 @@ void UMCGraspController::SetupFingers()
 				FingerConstraint->SetOrientationDriveSLERP(true);
 			}
 			FingerConstraint->SetAngularDriveParams(Spring, Damping, ForceLimit);
+
+			FingerConstraints.Add(FingerConstraint);
+			FingerJointIndices.Add(JointIdx);
+			FingerBodies.Add(SkeletalHand->GetBodyInstance(BoneName));
+			DriveTargets.Add(FQuat::Identity);
+			AppliedDriveTargets.Add(FQuat::Identity);
+			LastJointValues.Add(-1.f);
+			FingerBoneRefs.Add(FingerBones[JointIdx]);
+			FingerBodyIndices.Add(BoneName, FingerConstraints.Num() - 1);
+			ContactStartFrames.Add(0);
+			LastContactFrames.Add(0);
+			JointsInContact.Add(false);
+			SoftenedDrives.Add(false);
+			ContactActors.Add(nullptr);
+			ContactNormals.Add(FVector::ZeroVector);
 		}
 		else
 		{
-			UE_LOG(LogTemp, Error, TEXT("[%s] Could not find ConstraintInstance for bone %s"), *BoneAndTypeItr.BoneName)
+			UE_LOG(LogTemp, Error, TEXT("[%s] Could not find ConstraintInstance for bone %s"),
+				*FString(__FUNCTION__), *BoneName.ToString());
 		}
 	}
 }
 
-// Get finger constraint
-FConstraintInstance* UMCGraspController::GetFingerConstraint(const FString& BoneName)
+// Get finger constraint, nullptr if the hand has no constraint with the bone name
+FConstraintInstance* UMCGraspController::GetFingerConstraint(FName BoneName) const
 {
-	return *SkeletalHand->Constraints.FindByPredicate(
-		[&BoneName](FConstraintInstance* ConstrInst) {return ConstrInst->JointName.ToString() == BoneName; }
-	);
+	return SkeletonIndexMap.IsValid() ? SkeletonIndexMap->FindConstraint(SkeletalHand, BoneName) : nullptr;
 }
 
 // Update grasp
 void UMCGraspController::Update(const float Val)
 {
-	Thumb.Distal.ConstraintInstance->SetAngularOrientationTarget(FQuat(FRotator(0.f, 0.f, Val * UpdateMultiplier)));
-	Thumb.Intermediate.ConstraintInstance->SetAngularOrientationTarget(FQuat(FRotator(0.f, 0.f, Val * UpdateMultiplier)));
-	Thumb.Proximal.ConstraintInstance->SetAngularOrientationTarget(FQuat(FRotator(0.f, 0.f, Val * UpdateMultiplier)));
+	// The axis is polled every frame, skip the update if the input did not change
+	LastInputValue = Val;
+	if (FMath::Abs(Val - LastUpdateValue) < UpdateEpsilon)
+	{
+		return;
+	}
+	LastUpdateValue = Val;
+
+	// Every finger bone is driven towards the same target without a grasp style
+	const FQuat Target(FRotator(0.f, 0.f, Val * UpdateMultiplier));
+	for (int32 Idx = 0; Idx < DriveTargets.Num(); ++Idx)
+	{
+		// Joints in contact do not close any further
+		if (IsJointHeld(Idx, Val))
+		{
+			continue;
+		}
+
+		// Table lookup of the grasp style
+		DriveTargets[Idx] = ActiveGraspPose ? ActiveGraspPose->GetJointTarget(FingerJointIndices[Idx], Val) : Target;
+		LastJointValues[Idx] = Val;
+	}
+
+	WriteDriveTargets();
+}
+
+// Publish the joint values of the device, lock-free for a single producer thread
+bool UMCGraspController::PushJointInput(const float* InValues, int32 InNumValues)
+{
+	// One value per finger or one per joint
+	if (InNumValues != FMCJointInput::MaxValues / 3 && InNumValues != FMCJointInput::MaxValues)
+	{
+		return false;
+	}
+
+	FMCJointInput JointInput;
+	FMemory::Memcpy(JointInput.Values, InValues, InNumValues * sizeof(float));
+	JointInput.NumValues = InNumValues;
+	JointInputSlot->Write(JointInput);
+	return true;
+}
+
+// Apply the latest published joint input, only the changed joints are written (game thread)
+void UMCGraspController::UpdateJointInput()
+{
+	// The device can stream faster than the frame rate, only the latest sample is applied
+	if (JointInputSlot->Read(LatestJointInput))
+	{
+		if (ApplyJointInput(LatestJointInput))
+		{
+			WriteDriveTargets();
+		}
+	}
+}
 
-	Index.Distal.ConstraintInstance->SetAngularOrientationTarget(FQuat(FRotator(0.f, 0.f, Val * UpdateMultiplier)));
-	Index.Intermediate.ConstraintInstance->SetAngularOrientationTarget(FQuat(FRotator(0.f, 0.f, Val * UpdateMultiplier)));
-	Index.Proximal.ConstraintInstance->SetAngularOrientationTarget(FQuat(FRotator(0.f, 0.f, Val * UpdateMultiplier)));
+// Set the targets of the joints whose value changed, true if any changed
+bool UMCGraspController::ApplyJointInput(const FMCJointInput& InJointInput)
+{
+	if (InJointInput.NumValues == 0)
+	{
+		return false;
+	}
 
-	Middle.Distal.ConstraintInstance->SetAngularOrientationTarget(FQuat(FRotator(0.f, 0.f, Val * UpdateMultiplier)));
-	Middle.Intermediate.ConstraintInstance->SetAngularOrientationTarget(FQuat(FRotator(0.f, 0.f, Val * UpdateMultiplier)));
-	Middle.Proximal.ConstraintInstance->SetAngularOrientationTarget(FQuat(FRotator(0.f, 0.f, Val * UpdateMultiplier)));
+	// Per finger values drive the three joints of the finger
+	const int32 JointsPerValue = FMCJointInput::MaxValues / InJointInput.NumValues;
 
-	Ring.Distal.ConstraintInstance->SetAngularOrientationTarget(FQuat(FRotator(0.f, 0.f, Val * UpdateMultiplier)));
-	Ring.Intermediate.ConstraintInstance->SetAngularOrientationTarget(FQuat(FRotator(0.f, 0.f, Val * UpdateMultiplier)));
-	Ring.Proximal.ConstraintInstance->SetAngularOrientationTarget(FQuat(FRotator(0.f, 0.f, Val * UpdateMultiplier)));
+	bool bChanged = false;
+	for (int32 Idx = 0; Idx < DriveTargets.Num(); ++Idx)
+	{
+		const int32 JointIdx = FingerJointIndices[Idx];
+		const float Val = InJointInput.Values[JointIdx / JointsPerValue];
+		if (FMath::Abs(Val - LastJointValues[Idx]) < UpdateEpsilon || IsJointHeld(Idx, Val))
+		{
+			continue;
+		}
+		LastJointValues[Idx] = Val;
+		DriveTargets[Idx] = ActiveGraspPose ?
+			ActiveGraspPose->GetJointTarget(JointIdx, Val) : FQuat(FRotator(0.f, 0.f, Val * UpdateMultiplier));
+		bChanged = true;
+	}
+	return bChanged;
+}
 
-	Pinky.Distal.ConstraintInstance->SetAngularOrientationTarget(FQuat(FRotator(0.f, 0.f, Val * UpdateMultiplier)));
-	Pinky.Intermediate.ConstraintInstance->SetAngularOrientationTarget(FQuat(FRotator(0.f, 0.f, Val * UpdateMultiplier)));
-	Pinky.Proximal.ConstraintInstance->SetAngularOrientationTarget(FQuat(FRotator(0.f, 0.f, Val * UpdateMultiplier)));
+// Write the changed drive targets of all the finger constraints under a single scene lock
+void UMCGraspController::WriteDriveTargets()
+{
+	FPhysScene* PhysScene = SkeletalHand ? SkeletalHand->GetWorld()->GetPhysicsScene() : nullptr;
+	if (!PhysScene)
+	{
+		return;
+	}
+
+	FPhysicsCommand::ExecuteWrite(PhysScene, [this]()
+	{
+		for (int32 Idx = 0; Idx < FingerConstraints.Num(); ++Idx)
+		{
+			FConstraintInstance* Constraint = FingerConstraints[Idx];
+
+			// Soften the drives of the joints in contact, restore them when the contact ends
+			if (SoftenedDrives[Idx] != JointsInContact[Idx])
+			{
+				const float Scale = JointsInContact[Idx] ? ContactDriveScale : 1.f;
+				Constraint->ProfileInstance.AngularDrive.SetDriveParams(Spring * Scale, Damping, ForceLimit * Scale);
+				FPhysicsInterface::UpdateAngularDrive_AssumesLocked(Constraint->ConstraintHandle, Constraint->ProfileInstance.AngularDrive);
+				SoftenedDrives[Idx] = JointsInContact[Idx];
+			}
+
+			if (DriveTargets[Idx].Equals(AppliedDriveTargets[Idx], KINDA_SMALL_NUMBER))
+			{
+				continue;
+			}
+
+			// Setting the drive target wakes up the constrained bodies
+			if (FingerBodies[Idx] && FPhysicsInterface::IsSleeping(FingerBodies[Idx]->ActorHandle))
+			{
+				INC_DWORD_STAT(STAT_MCFingerBodyWakeUps);
+			}
+
+			Constraint->ProfileInstance.AngularDrive.OrientationTarget = DriveTargets[Idx].Rotator();
+			FPhysicsInterface::SetDriveOrientation(Constraint->ConstraintHandle, DriveTargets[Idx]);
+			AppliedDriveTargets[Idx] = DriveTargets[Idx];
+			INC_DWORD_STAT(STAT_MCFingerDriveWrites);
+		}
+	});
+	INC_DWORD_STAT(STAT_MCPhysicsSceneLocks);
+}
+
+// Contact callback of the hand bodies
+void UMCGraspController::OnFingerHit(UPrimitiveComponent* HitComp, AActor* OtherActor, UPrimitiveComponent* OtherComp,
+	FVector NormalImpulse, const FHitResult& Hit)
+{
+	// Ignore the contacts between the bodies of the hand
+	if (OtherComp == SkeletalHand)
+	{
+		return;
+	}
+
+	if (const int32* Idx = FingerBodyIndices.Find(Hit.MyBoneName))
+	{
+		// Contacts are reported every physics frame while they persist
+		if (LastContactFrames[*Idx] + 1 < GFrameCounter || ContactActors[*Idx] != OtherActor)
+		{
+			ContactStartFrames[*Idx] = GFrameCounter;
+		}
+		LastContactFrames[*Idx] = GFrameCounter;
+		ContactActors[*Idx] = OtherActor;
+		ContactNormals[*Idx] = Hit.ImpactNormal;
+	}
+}
+
+// Update the contact state of the finger joints, softens or restores the drives (game thread)
+void UMCGraspController::UpdateFingerContacts()
+{
+	if (bHoldContacts)
+	{
+		return;
+	}
+
+	bool bChanged = false;
+	for (int32 Idx = 0; Idx < JointsInContact.Num(); ++Idx)
+	{
+		// In contact since the given number of frames, and touched in the current or the previous frame
+		const bool bInContact = LastContactFrames[Idx] + 1 >= GFrameCounter
+			&& LastContactFrames[Idx] - ContactStartFrames[Idx] + 1 >= static_cast<uint64>(ContactStableFrames);
+		if (bInContact != JointsInContact[Idx])
+		{
+			JointsInContact[Idx] = bInContact;
+			FingerBoneRefs[Idx]->bInContact = bInContact;
+			bChanged = true;
+		}
+	}
+
+	// Let the next input close the released joints
+	if (bChanged)
+	{
+		LastUpdateValue = -1.f;
+		WriteDriveTargets();
+	}
+}
+
+// Finger (thumb 0, index 1, middle 2, ring 3, pinky 4) is in stable contact with another object
+bool UMCGraspController::IsFingerInContact(int32 FingerIndex) const
+{
+	switch (FingerIndex)
+	{
+	case 0:
+		return Thumb.IsInContact();
+	case 1:
+		return Index.IsInContact();
+	case 2:
+		return Middle.IsInContact();
+	case 3:
+		return Ring.IsInContact();
+	case 4:
+		return Pinky.IsInContact();
+	default:
+		return false;
+	}
+}
+
+// Actor in stable contact with at least two fingers with opposing contact normals, nullptr if none
+AActor* UMCGraspController::GetOpposingContactActor() const
+{
+	for (int32 Idx = 0; Idx < JointsInContact.Num(); ++Idx)
+	{
+		AActor* ContactActor = ContactActors[Idx].Get();
+		if (!JointsInContact[Idx] || !IsValid(ContactActor))
+		{
+			continue;
+		}
+
+		// Joints of another finger touching the same actor from the opposite side
+		const int32 FingerIdx = FingerJointIndices[Idx] / 3;
+		for (int32 OtherIdx = Idx + 1; OtherIdx < JointsInContact.Num(); ++OtherIdx)
+		{
+			if (JointsInContact[OtherIdx]
+				&& ContactActors[OtherIdx] == ContactActors[Idx]
+				&& FingerJointIndices[OtherIdx] / 3 != FingerIdx
+				&& (ContactNormals[Idx] | ContactNormals[OtherIdx]) < 0.f)
+			{
+				return ContactActor;
+			}
+		}
+	}
+	return nullptr;
+}
+
+// Current closing value of the hand (0..1), the average of the joint values with device input
+float UMCGraspController::GetGraspValue() const
+{
+	if (bUseJointInput)
+	{
+		float Sum = 0.f;
+		for (int32 Idx = 0; Idx < LatestJointInput.NumValues; ++Idx)
+		{
+			Sum += LatestJointInput.Values[Idx];
+		}
+		return LatestJointInput.NumValues > 0 ? Sum / LatestJointInput.NumValues : 0.f;
+	}
+	return LastInputValue;
+}
+
+// Bone indices of the finger joints in the grasp pose joint order, INDEX_NONE if not found (does not require Init)
+void UMCGraspController::GetJointBoneIndices(const FMCSkeletonIndexMap& InIndexMap, TArray<int32>& OutBoneIndices) const
+{
+	const TArray<FString>& JointNames = UMCGraspPose::GetJointNames();
+	OutBoneIndices.Reset(JointNames.Num());
+	for (const FString& JointName : JointNames)
+	{
+		// The hand type might not be known yet, both postfixes are tried
+		const FName* MappedBoneName = BoneNameMapping.Find(JointName);
+		int32 BoneIdx = MappedBoneName ? InIndexMap.GetBoneIndex(*MappedBoneName) : INDEX_NONE;
+		if (BoneIdx == INDEX_NONE)
+		{
+			BoneIdx = InIndexMap.GetBoneIndex(FName(*(JointName + TEXT("_l"))));
+		}
+		if (BoneIdx == INDEX_NONE)
+		{
+			BoneIdx = InIndexMap.GetBoneIndex(FName(*(JointName + TEXT("_r"))));
+		}
+		OutBoneIndices.Add(BoneIdx);
+	}
 }
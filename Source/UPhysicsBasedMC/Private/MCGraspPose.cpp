@@ -0,0 +1,90 @@
+// Copyright 2018, Institute for Artificial Intelligence - University of Bremen
+// Author: Andrei Haidu (http://haidu.eu)
+
+#include "MCGraspPose.h"
+
+// Joint target at the given grasp value
+FQuat FMCGraspJointCurves::Evaluate(float InValue) const
+{
+	return FQuat(FRotator(
+		Pitch.GetRichCurveConst()->Eval(InValue),
+		Yaw.GetRichCurveConst()->Eval(InValue),
+		Roll.GetRichCurveConst()->Eval(InValue)));
+}
+
+// Constructor, set default values
+UMCGraspPose::UMCGraspPose()
+{
+	TableResolution = 33;
+}
+
+// Bake the table after loading
+void UMCGraspPose::PostLoad()
+{
+	Super::PostLoad();
+	JointTargetTable.Empty();
+	Bake();
+}
+
+#if WITH_EDITOR
+// Re-bake the table after editing the curves
+void UMCGraspPose::PostEditChangeProperty(struct FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+	JointTargetTable.Empty();
+	Bake();
+}
+#endif // WITH_EDITOR
+
+// Finger joint names without the hand postfix, in the order of the table
+const TArray<FString>& UMCGraspPose::GetJointNames()
+{
+	static const TArray<FString> JointNames = {
+		TEXT("thumb_03"), TEXT("thumb_02"), TEXT("thumb_01"),
+		TEXT("index_03"), TEXT("index_02"), TEXT("index_01"),
+		TEXT("middle_03"), TEXT("middle_02"), TEXT("middle_01"),
+		TEXT("ring_03"), TEXT("ring_02"), TEXT("ring_01"),
+		TEXT("pinky_03"), TEXT("pinky_02"), TEXT("pinky_01") };
+	return JointNames;
+}
+
+// Bake the curves into the lookup table if it is out of date
+void UMCGraspPose::Bake()
+{
+	const TArray<FString>& JointNames = GetJointNames();
+	const int32 NumSamples = FMath::Max(TableResolution, 2);
+	if (JointTargetTable.Num() == NumSamples * JointNames.Num())
+	{
+		return;
+	}
+
+	JointTargetTable.SetNumUninitialized(NumSamples * JointNames.Num());
+	for (int32 JointIdx = 0; JointIdx < JointNames.Num(); ++JointIdx)
+	{
+		// Joints without curves keep their reference pose
+		const FMCGraspJointCurves* Curves = JointCurves.Find(JointNames[JointIdx]);
+		for (int32 SampleIdx = 0; SampleIdx < NumSamples; ++SampleIdx)
+		{
+			const float Value = static_cast<float>(SampleIdx) / (NumSamples - 1);
+			JointTargetTable[SampleIdx * JointNames.Num() + JointIdx] = Curves ? Curves->Evaluate(Value) : FQuat::Identity;
+		}
+	}
+}
+
+// Joint target at the given grasp value (0..1), table lookup and slerp
+FQuat UMCGraspPose::GetJointTarget(int32 JointIndex, float InValue) const
+{
+	const int32 NumJoints = GetJointNames().Num();
+	if (JointTargetTable.Num() < 2 * NumJoints || !GetJointNames().IsValidIndex(JointIndex))
+	{
+		return FQuat::Identity;
+	}
+
+	const int32 NumSamples = JointTargetTable.Num() / NumJoints;
+	const float Sample = FMath::Clamp(InValue, 0.f, 1.f) * (NumSamples - 1);
+	const int32 SampleIdx = FMath::Min(FMath::FloorToInt(Sample), NumSamples - 2);
+	return FQuat::Slerp(
+		JointTargetTable[SampleIdx * NumJoints + JointIndex],
+		JointTargetTable[(SampleIdx + 1) * NumJoints + JointIndex],
+		Sample - SampleIdx);
+}
@@ -0,0 +1,409 @@
+// Copyright 2018, Institute for Artificial Intelligence - University of Bremen
+// Author: Andrei Haidu (http://haidu.eu)
+
+#include "MCGraspabilityRegistry.h"
+#include "UPhysicsBasedMC.h"
+#include "EngineUtils.h"
+#include "Async/ParallelFor.h"
+
+DECLARE_CYCLE_STAT(TEXT("Graspability Registry Build"), STAT_MCGraspabilityBuild, STATGROUP_PhysicsBasedMC);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Graspability Entry Updates"), STAT_MCGraspabilityUpdates, STATGROUP_PhysicsBasedMC);
+DECLARE_CYCLE_STAT(TEXT("Graspability Spatial Hash Update"), STAT_MCGraspabilityHashUpdate, STATGROUP_PhysicsBasedMC);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Graspability Cell Moves"), STAT_MCGraspabilityCellMoves, STATGROUP_PhysicsBasedMC);
+
+// Sets default values
+AMCGraspabilityRegistry::AMCGraspabilityRegistry()
+{
+	// Update the spatial hash after the objects moved
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.TickGroup = TG_PostPhysics;
+	MinParallelBuildSize = 64;
+	CellSize = 50.f;
+}
+
+// Get the registry of the world, spawn one if none is available
+AMCGraspabilityRegistry* AMCGraspabilityRegistry::GetInstance(UWorld* InWorld)
+{
+	if (AMCGraspabilityRegistry* Registry = FindInstance(InWorld))
+	{
+		return Registry;
+	}
+	return InWorld ? InWorld->SpawnActor<AMCGraspabilityRegistry>() : nullptr;
+}
+
+// Get the registry of the world, nullptr if none is available (does not spawn one)
+AMCGraspabilityRegistry* AMCGraspabilityRegistry::FindInstance(UWorld* InWorld)
+{
+	if (!InWorld)
+	{
+		return nullptr;
+	}
+
+	for (TActorIterator<AMCGraspabilityRegistry> Itr(InWorld); Itr; ++Itr)
+	{
+		return *Itr;
+	}
+	return nullptr;
+}
+
+// Called when the game starts or when spawned
+void AMCGraspabilityRegistry::BeginPlay()
+{
+	Super::BeginPlay();
+	Build();
+}
+
+// Called every frame, after physics
+void AMCGraspabilityRegistry::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	SCOPE_CYCLE_COUNTER(STAT_MCGraspabilityHashUpdate);
+
+	// Only the actors leaving their cell are moved in the hash
+	for (const int32 Idx : MovableEntries)
+	{
+		AStaticMeshActor* SMA = EntryActors[Idx].Get();
+		if (!SMA)
+		{
+			StaleEntries.Add(Idx);
+			continue;
+		}
+
+		const FIntVector Cell = GetCell(SMA->GetActorLocation());
+		if (Cell != EntryCells[Idx])
+		{
+			INC_DWORD_STAT(STAT_MCGraspabilityCellMoves);
+			RemoveFromCell(Idx);
+			EntryCells[Idx] = Cell;
+			AddToCell(Idx);
+		}
+	}
+	RemoveStaleEntries();
+}
+
+// Check if the actor can be grasped with the given limits, one table lookup if the entry is up to date
+bool AMCGraspabilityRegistry::CanBeGrasped(AStaticMeshActor* InSMA, float InMaxMass, float InMaxLength)
+{
+	const FMCGraspableEntry& Entry = FindOrUpdate(InSMA);
+	if (Entry.Override != EMCGraspableOverride::None)
+	{
+		return Entry.Override == EMCGraspableOverride::Graspable;
+	}
+	return Entry.bMovable && Entry.bSimulating && Entry.Mass < InMaxMass && Entry.Length < InMaxLength;
+}
+
+// Entry of the actor, added or recomputed if needed
+const FMCGraspableEntry& AMCGraspabilityRegistry::FindOrUpdate(AStaticMeshActor* InSMA)
+{
+	if (const int32* Idx = EntryIndices.Find(FObjectKey(InSMA)))
+	{
+		return UpdateEntry(*Idx);
+	}
+
+	// Actors spawned after the build are added on their first use
+	const int32 Idx = Entries.AddDefaulted();
+	EntryIndices.Add(FObjectKey(InSMA), Idx);
+	EntryActors.Add(InSMA);
+	EntryKeys.Add(FObjectKey(InSMA));
+	EntryCells.Add(GetCell(InSMA->GetActorLocation()));
+	InSMA->OnDestroyed.AddUniqueDynamic(this, &AMCGraspabilityRegistry::OnEntryActorDestroyed);
+	const FMCGraspableEntry& Entry = UpdateEntry(Idx);
+	if (Entry.bMovable)
+	{
+		MovableEntries.Add(Idx);
+		AddToCell(Idx);
+	}
+	return Entry;
+}
+
+// Call the function with the entry index of every hashed actor in the cells overlapping the sphere
+template<typename FunctionType>
+void AMCGraspabilityRegistry::ForEachInRadius(const FVector& InLocation, float InRadius, FunctionType Function)
+{
+	const FIntVector MinCell = GetCell(InLocation - FVector(InRadius));
+	const FIntVector MaxCell = GetCell(InLocation + FVector(InRadius));
+	for (int32 X = MinCell.X; X <= MaxCell.X; ++X)
+	{
+		for (int32 Y = MinCell.Y; Y <= MaxCell.Y; ++Y)
+		{
+			for (int32 Z = MinCell.Z; Z <= MaxCell.Z; ++Z)
+			{
+				if (const TArray<int32>* Cell = Cells.Find(FIntVector(X, Y, Z)))
+				{
+					for (const int32 Idx : *Cell)
+					{
+						if (!EntryActors[Idx].IsValid())
+						{
+							StaleEntries.Add(Idx);
+							continue;
+						}
+
+						// Only the currently graspable actors (e.g. not the attached ones)
+						const FMCGraspableEntry& Entry = UpdateEntry(Idx);
+						const bool bGraspable = Entry.Override == EMCGraspableOverride::None
+							? Entry.bMovable && Entry.bSimulating
+							: Entry.Override == EMCGraspableOverride::Graspable;
+						if (bGraspable)
+						{
+							Function(Idx);
+						}
+					}
+				}
+			}
+		}
+	}
+	RemoveStaleEntries();
+}
+
+// Nearest graspable actor within the distance, false if none
+bool AMCGraspabilityRegistry::FindNearest(const FVector& InLocation, float InMaxDistance, FMCApproachInfo& OutInfo)
+{
+	// The actor is kept, the stale entries are removed after the iteration and can move the indices
+	AStaticMeshActor* Nearest = nullptr;
+	float NearestDistSq = FMath::Square(InMaxDistance);
+	ForEachInRadius(InLocation, InMaxDistance, [this, &InLocation, &Nearest, &NearestDistSq](int32 Idx)
+	{
+		AStaticMeshActor* SMA = EntryActors[Idx].Get();
+		const float DistSq = FVector::DistSquared(InLocation, SMA->GetActorLocation());
+		if (DistSq < NearestDistSq)
+		{
+			NearestDistSq = DistSq;
+			Nearest = SMA;
+		}
+	});
+
+	if (!Nearest)
+	{
+		OutInfo = FMCApproachInfo();
+		return false;
+	}
+
+	const FVector ToObject = Nearest->GetActorLocation() - InLocation;
+	OutInfo.Object = Nearest;
+	OutInfo.Distance = FMath::Sqrt(NearestDistSq);
+	OutInfo.Direction = ToObject.GetSafeNormal();
+	return true;
+}
+
+// Graspable actors within the radius
+void AMCGraspabilityRegistry::FindInRadius(const FVector& InLocation, float InRadius, TArray<AStaticMeshActor*>& OutActors)
+{
+	const float RadiusSq = FMath::Square(InRadius);
+	ForEachInRadius(InLocation, InRadius, [this, &InLocation, RadiusSq, &OutActors](int32 Idx)
+	{
+		AStaticMeshActor* SMA = EntryActors[Idx].Get();
+		if (FVector::DistSquared(InLocation, SMA->GetActorLocation()) < RadiusSq)
+		{
+			OutActors.Add(SMA);
+		}
+	});
+}
+
+// Recompute the entry if needed
+const FMCGraspableEntry& AMCGraspabilityRegistry::UpdateEntry(int32 InIdx)
+{
+	// The scale changes the mass and the bounds, the simulation state is a flag read,
+	// mass changes are not detected (see Invalidate)
+	FMCGraspableEntry& Entry = Entries[InIdx];
+	AStaticMeshActor* SMA = EntryActors[InIdx].Get();
+	if (!SMA)
+	{
+		return Entry;
+	}
+	const UStaticMeshComponent* SMC = SMA->GetStaticMeshComponent();
+	if (Entry.bDirty || !Entry.Scale.Equals(SMA->GetActorScale3D())
+		|| Entry.bSimulating != (SMC && SMC->IsSimulatingPhysics()))
+	{
+		INC_DWORD_STAT(STAT_MCGraspabilityUpdates);
+		Entry = ComputeEntry(SMA);
+		if (const EMCGraspableOverride* Override = ActorOverrides.Find(FObjectKey(SMA)))
+		{
+			Entry.Override = *Override;
+		}
+	}
+	return Entry;
+}
+
+// Add the actor to its spatial hash cell
+void AMCGraspabilityRegistry::AddToCell(int32 InIdx)
+{
+	Cells.FindOrAdd(EntryCells[InIdx]).Add(InIdx);
+}
+
+// Remove the actor from its spatial hash cell
+void AMCGraspabilityRegistry::RemoveFromCell(int32 InIdx)
+{
+	if (TArray<int32>* Cell = Cells.Find(EntryCells[InIdx]))
+	{
+		Cell->RemoveSingleSwap(InIdx, false);
+		if (Cell->Num() == 0)
+		{
+			Cells.Remove(EntryCells[InIdx]);
+		}
+	}
+}
+
+// Remove the entry, the last entry takes its index
+void AMCGraspabilityRegistry::RemoveEntry(int32 InIdx)
+{
+	const int32 MovableIdx = MovableEntries.Find(InIdx);
+	if (MovableIdx != INDEX_NONE)
+	{
+		RemoveFromCell(InIdx);
+		MovableEntries.RemoveAtSwap(MovableIdx, 1, false);
+	}
+	EntryIndices.Remove(EntryKeys[InIdx]);
+	ActorOverrides.Remove(EntryKeys[InIdx]);
+
+	// Point the references of the last entry to its new index
+	const int32 LastIdx = Entries.Num() - 1;
+	if (InIdx != LastIdx)
+	{
+		EntryIndices.FindChecked(EntryKeys[LastIdx]) = InIdx;
+		const int32 LastMovableIdx = MovableEntries.Find(LastIdx);
+		if (LastMovableIdx != INDEX_NONE)
+		{
+			MovableEntries[LastMovableIdx] = InIdx;
+			TArray<int32>& Cell = Cells.FindChecked(EntryCells[LastIdx]);
+			Cell[Cell.Find(LastIdx)] = InIdx;
+		}
+	}
+
+	Entries.RemoveAtSwap(InIdx, 1, false);
+	EntryActors.RemoveAtSwap(InIdx, 1, false);
+	EntryKeys.RemoveAtSwap(InIdx, 1, false);
+	EntryCells.RemoveAtSwap(InIdx, 1, false);
+}
+
+// Remove the entries of the actors found destroyed while iterating
+void AMCGraspabilityRegistry::RemoveStaleEntries()
+{
+	if (StaleEntries.Num() == 0)
+	{
+		return;
+	}
+
+	// Highest index first, the entries moved into the removed slots are never stale ones
+	StaleEntries.Sort(TGreater<int32>());
+	int32 PrevIdx = INDEX_NONE;
+	for (const int32 Idx : StaleEntries)
+	{
+		if (Idx != PrevIdx)
+		{
+			RemoveEntry(Idx);
+			PrevIdx = Idx;
+		}
+	}
+	StaleEntries.Reset();
+}
+
+// Remove the entry of the destroyed actor
+void AMCGraspabilityRegistry::OnEntryActorDestroyed(AActor* InActor)
+{
+	if (const int32* Idx = EntryIndices.Find(FObjectKey(InActor)))
+	{
+		RemoveEntry(*Idx);
+	}
+}
+
+// Recompute the entry of the actor on its next use (e.g. its mass or simulation state changed)
+void AMCGraspabilityRegistry::Invalidate(AActor* InActor)
+{
+	if (const int32* Idx = EntryIndices.Find(FObjectKey(InActor)))
+	{
+		Entries[*Idx].bDirty = true;
+	}
+}
+
+// Override the graspability of the actor
+void AMCGraspabilityRegistry::SetOverride(AActor* InActor, EMCGraspableOverride InOverride)
+{
+	ActorOverrides.Add(FObjectKey(InActor), InOverride);
+	Invalidate(InActor);
+}
+
+// Override the graspability of the actors with the given tag (e.g. a semantic class tag)
+void AMCGraspabilityRegistry::SetTagOverride(FName InTag, EMCGraspableOverride InOverride)
+{
+	TagOverrides.Add(InTag, InOverride);
+
+	// The tags are not cached, recompute all the entries on their next use
+	for (FMCGraspableEntry& Entry : Entries)
+	{
+		Entry.bDirty = true;
+	}
+}
+
+// Build the entries of all the static mesh actors of the world
+void AMCGraspabilityRegistry::Build()
+{
+	SCOPE_CYCLE_COUNTER(STAT_MCGraspabilityBuild);
+
+	TArray<AStaticMeshActor*> Actors;
+	for (TActorIterator<AStaticMeshActor> Itr(GetWorld()); Itr; ++Itr)
+	{
+		Actors.Add(*Itr);
+	}
+
+	// The entries are only read from the actors, the bounding boxes are the bulk of the work
+	Entries.SetNum(Actors.Num());
+	ParallelFor(Actors.Num(), [this, &Actors](int32 Idx)
+	{
+		Entries[Idx] = ComputeEntry(Actors[Idx]);
+	}, Actors.Num() < MinParallelBuildSize);
+
+	// The movable actors are hashed by their current location
+	EntryIndices.Empty(Actors.Num());
+	EntryActors.Empty(Actors.Num());
+	EntryKeys.Empty(Actors.Num());
+	EntryCells.SetNum(Actors.Num());
+	MovableEntries.Empty();
+	Cells.Empty();
+	for (int32 Idx = 0; Idx < Actors.Num(); ++Idx)
+	{
+		EntryIndices.Add(FObjectKey(Actors[Idx]), Idx);
+		EntryActors.Add(Actors[Idx]);
+		EntryKeys.Add(FObjectKey(Actors[Idx]));
+		Actors[Idx]->OnDestroyed.AddUniqueDynamic(this, &AMCGraspabilityRegistry::OnEntryActorDestroyed);
+		EntryCells[Idx] = GetCell(Actors[Idx]->GetActorLocation());
+		if (Entries[Idx].bMovable)
+		{
+			MovableEntries.Add(Idx);
+			AddToCell(Idx);
+		}
+	}
+}
+
+// Compute the entry of the actor, does not modify the registry (thread safe)
+FMCGraspableEntry AMCGraspabilityRegistry::ComputeEntry(const AStaticMeshActor* InSMA) const
+{
+	FMCGraspableEntry Entry;
+	Entry.bDirty = false;
+	Entry.Scale = InSMA->GetActorScale3D();
+	Entry.Override = GetTagOverride(InSMA);
+	Entry.bMovable = InSMA->IsRootComponentMovable();
+
+	// Mass and bounds are only needed for the movable simulated actors
+	const UStaticMeshComponent* SMC = InSMA->GetStaticMeshComponent();
+	Entry.bSimulating = SMC && SMC->IsSimulatingPhysics();
+	if (Entry.bMovable && Entry.bSimulating)
+	{
+		Entry.Mass = SMC->GetMass();
+		Entry.Length = InSMA->GetComponentsBoundingBox().GetSize().Size();
+	}
+	return Entry;
+}
+
+// Override of the actor from its tags
+EMCGraspableOverride AMCGraspabilityRegistry::GetTagOverride(const AActor* InActor) const
+{
+	for (const FName& Tag : InActor->Tags)
+	{
+		if (const EMCGraspableOverride* Override = TagOverrides.Find(Tag))
+		{
+			return *Override;
+		}
+	}
+	return EMCGraspableOverride::None;
+}
@@ -2,6 +2,14 @@
 // Author: Andrei Haidu (http://haidu.eu)
 
 #include "MCHand.h"
+#include "GameFramework/GameStateBase.h"
+#include "UPhysicsBasedMC.h"
+#include "Engine/Engine.h"
+
+DECLARE_CYCLE_STAT(TEXT("Send Pose"), STAT_MCSendPose, STATGROUP_PhysicsBasedMC);
+DECLARE_CYCLE_STAT(TEXT("Receive Pose"), STAT_MCReceivePose, STATGROUP_PhysicsBasedMC);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Hand Pose Bytes Per Second (All Hands)"), STAT_MCHandPoseBytesPerSecond, STATGROUP_PhysicsBasedMC);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Replicated Hands"), STAT_MCReplicatedHands, STATGROUP_PhysicsBasedMC);
 
 // Sets default values
 UMCHand::UMCHand(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer)
@@ -32,9 +40,48 @@ UMCHand::UMCHand(const FObjectInitializer& ObjectInitializer) : Super(ObjectInit
 	// Enable fixation grasp by default
 	bEnableFixationGrasp = true;
 
+	// No approach queries by default
+	ApproachQueryDistance = 0.f;
+	GraspabilityRegistry = nullptr;
+
 	// Initialize poseable mesh
 	PoseableMesh = ObjectInitializer.CreateDefaultSubobject<UPoseableMeshComponent>(this, TEXT("PoseableMesh"));
 
+	// Replicate the quantized pose by default
+	PoseReplication = EMCPoseReplication::QuantizedBones;
+	PoseLocationThreshold = 0.05f;
+	PoseRotationThreshold = 0.5f;
+	PoseKeyframeInterval = 30;
+	PoseUpdatesSinceKeyframe = 0;
+	ReplicatedBoneTransformsTime = 0.f;
+	bPoseOnKeyframe = false;
+
+	// Apply the received poses right away by default
+	bInterpolatePoses = false;
+	PoseInterpolationDelay = 0.1f;
+	MaxPoseExtrapolation = 0.1f;
+	PoseBufferSize = 16;
+
+	// Send every pose update by default
+	bAdaptiveReplication = false;
+	IdlePoseUpdateRate = 2.f;
+	MaxPoseUpdateRate = 90.f;
+	IdleMotion = 2.f;
+	FullRateMotion = 50.f;
+	AngularMotionScale = 0.2f;
+	IdleNetPriorityScale = 0.25f;
+	GraspBurstDuration = 0.5f;
+	bShowPoseBandwidth = false;
+	Motion = 0.f;
+	PoseUpdateRate = MaxPoseUpdateRate;
+	NetPriorityScale = 1.f;
+	BurstTimeLeft = 0.f;
+	bWasGrasping = false;
+	LastPoseUpdateTime = 0.f;
+	PoseBytesInWindow = 0;
+	PoseBytesWindowStart = 0.f;
+	PoseBytesPerSecond = 0.f;
+
 	// Turn on replictation
 	this->SetIsReplicated(true);
 }
@@ -54,9 +101,34 @@ void UMCHand::BeginPlay()
 	PoseableMesh->SetSkeletalMesh(this->SkeletalMesh);
 	PoseableMesh->SetMobility(EComponentMobility::Movable);
 
-	// Writes the names of all bones into a replicated array
-	GetBoneNames(ReplicatedBoneNames);
+	// Writes the names of all bones into a replicated array, from the map shared by the hands with the same mesh
+	BoneIndexMap = FMCSkeletonIndexMap::Get(this);
+	if (BoneIndexMap.IsValid())
+	{
+		ReplicatedBoneNames = BoneIndexMap->BoneNames;
+	}
 	ReplicatedBoneTransforms.SetNum(ReplicatedBoneNames.Num(), true);
+
+	// Bones not received yet are kept in the reference pose
+	ReceivedBoneTransforms.Init(FTransform::Identity, ReplicatedBoneNames.Num());
+	if (SkeletalMesh && BoneIndexMap.IsValid())
+	{
+		const TArray<FTransform>& RefBonePose = SkeletalMesh->RefSkeleton.GetRefBonePose();
+		for (int32 BoneIdx = 0; BoneIdx < ReceivedBoneTransforms.Num() && BoneIdx < RefBonePose.Num(); ++BoneIdx)
+		{
+			const int32 ParentIdx = BoneIndexMap->ParentIndices[BoneIdx];
+			ReceivedBoneTransforms[BoneIdx] = ParentIdx == INDEX_NONE
+				? RefBonePose[BoneIdx] : RefBonePose[BoneIdx] * ReceivedBoneTransforms[ParentIdx];
+		}
+	}
+	KeyframeBoneTransforms = ReceivedBoneTransforms;
+	PoseSnapshots.Reset(PoseBufferSize);
+
+	// Finger joints of the joint angle replication, resolved the same way on the server and the clients
+	if (BoneIndexMap.IsValid())
+	{
+		GraspController->GetJointBoneIndices(*BoneIndexMap, JointBoneIndices);
+	}
 }
 
 // Called every frame, used for motion control
@@ -64,13 +136,39 @@ void UMCHand::TickComponent(float DeltaTime, enum ELevelTick TickType, FActorCom
 {
 	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
 
-	// Update the movement control of the hand
-	MovementController->Update(DeltaTime);
+	// Update the movement control of the hand (late and batched updates run on their own before physics)
+	if (!MovementController->bLateUpdate && !MovementController->bBatchedUpdate)
+	{
+		MovementController->Update(DeltaTime);
+	}
+
+	// Hold the fingers in contact, then apply the latest glove or finger tracking input
+	if (GraspController->bContactAwareGrasp)
+	{
+		GraspController->UpdateFingerContacts();
+	}
+	if (GraspController->bUseJointInput)
+	{
+		GraspController->UpdateJointInput();
+	}
+
+	// Nearest graspable object, without physics scene queries
+	if (GraspabilityRegistry)
+	{
+		GraspabilityRegistry->FindNearest(GetComponentLocation(), ApproachQueryDistance, ApproachInfo);
+	}
+
+	// Weld the stably held objects, release them when the hand opens
+	if (bEnableFixationGrasp && FixationGraspController->bAutoFixation)
+	{
+		FixationGraspController->UpdateAutoFixation();
+	}
 
 #if WITH_MULTIPLAYER
 
 	if (bIsServer)
 	{
+		UpdateReplicationRate(DeltaTime);
 		SendPose();
 	}
 	else
@@ -100,10 +198,20 @@ void UMCHand::Init(UMotionControllerComponent* InMC)
 	// Init the grasp controller
 	GraspController->Init(this, HandType);
 
+	// Query the nearest graspable object every frame, the fixation grasp controller reuses the registry
+	if (ApproachQueryDistance > 0.f)
+	{
+		GraspabilityRegistry = AMCGraspabilityRegistry::GetInstance(GetWorld());
+	}
+
 	// Init the fixation grasp controller
 	if (bEnableFixationGrasp)
 	{
 		FixationGraspController->Init(this, InMC);
+		if (FixationGraspController->bAutoFixation)
+		{
+			FixationGraspController->SetupAutoFixation(GraspController);
+		}
 	}
 	else
 	{
@@ -136,40 +244,357 @@ void UMCHand::PostEditChangeProperty(struct FPropertyChangedEvent& PropertyChang
 // I use 2 replicated arrays instead of just one Map, because replciation currently doesn't work for maps
 void UMCHand::GetLifetimeReplicatedProps(TArray< FLifetimeProperty > & OutLifetimeProps) const {
 	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
-	DOREPLIFETIME(UMCHand, ReplicatedBoneNames);
-	DOREPLIFETIME(UMCHand, ReplicatedBoneTransforms);
+	DOREPLIFETIME_CONDITION(UMCHand, ReplicatedBoneNames, COND_Custom);
+	DOREPLIFETIME_CONDITION(UMCHand, ReplicatedBoneTransformsTime, COND_Custom);
+	DOREPLIFETIME_CONDITION(UMCHand, ReplicatedBoneTransforms, COND_Custom);
+	DOREPLIFETIME_CONDITION(UMCHand, ReplicatedKeyframe, COND_Custom);
+	DOREPLIFETIME_CONDITION(UMCHand, ReplicatedPose, COND_Custom);
+	DOREPLIFETIME_CONDITION(UMCHand, ReplicatedJointPose, COND_Custom);
 	DOREPLIFETIME(UMCHand, HasAttached);
 	DOREPLIFETIME(UMCHand, AttachedMesh);
 	DOREPLIFETIME(UMCHand, AttachedTransform);
 }
 
+// Replicate only the pose representation of the replication mode
+void UMCHand::PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker)
+{
+	Super::PreReplication(ChangedPropertyTracker);
+
+	// The owner updates at the rate of its fastest hand, the slower hands skip the net updates until their next pose is due
+	const float Time = GetWorld()->GetTimeSeconds();
+	const bool bSendPose = !bAdaptiveReplication || Time - LastPoseUpdateTime >= 1.f / PoseUpdateRate - KINDA_SMALL_NUMBER;
+	if (bSendPose)
+	{
+		LastPoseUpdateTime = Time;
+	}
+
+	DOREPLIFETIME_ACTIVE_OVERRIDE(UMCHand, ReplicatedBoneNames, PoseReplication == EMCPoseReplication::BoneTransforms);
+	DOREPLIFETIME_ACTIVE_OVERRIDE(UMCHand, ReplicatedBoneTransformsTime, bSendPose && PoseReplication == EMCPoseReplication::BoneTransforms);
+	DOREPLIFETIME_ACTIVE_OVERRIDE(UMCHand, ReplicatedBoneTransforms, bSendPose && PoseReplication == EMCPoseReplication::BoneTransforms);
+	DOREPLIFETIME_ACTIVE_OVERRIDE(UMCHand, ReplicatedKeyframe, PoseReplication == EMCPoseReplication::QuantizedBones);
+	DOREPLIFETIME_ACTIVE_OVERRIDE(UMCHand, ReplicatedPose, bSendPose && PoseReplication == EMCPoseReplication::QuantizedBones);
+	DOREPLIFETIME_ACTIVE_OVERRIDE(UMCHand, ReplicatedJointPose, bSendPose && PoseReplication == EMCPoseReplication::JointAngles);
+	if (!bSendPose)
+	{
+		return;
+	}
+
+	// Encoded once per net update, the bones changed since the keyframe are sent, so that lost updates
+	// and new connections only need the latest values of the keyframe and the pose (which are always resent)
+	if (PoseReplication == EMCPoseReplication::QuantizedBones)
+	{
+		const FTransform Root(GetComponentQuat(), GetComponentLocation());
+		const TArray<FTransform>& ComponentSpaceTransforms = GetComponentSpaceTransforms();
+		if (PoseUpdatesSinceKeyframe == 0 || KeyframeBoneTransforms.Num() != ComponentSpaceTransforms.Num())
+		{
+			ReplicatedKeyframe.Encode(Root, ComponentSpaceTransforms, KeyframeBoneTransforms, true, 0.f, 0.f);
+			ReplicatedKeyframe.ServerTime = Time;
+			AddPoseBytes(ReplicatedKeyframe.GetNumBytes());
+			PoseUpdatesSinceKeyframe = 0;
+		}
+		PoseUpdatesSinceKeyframe = (PoseUpdatesSinceKeyframe + 1) % PoseKeyframeInterval;
+
+		ReplicatedPose.Encode(Root, ComponentSpaceTransforms, KeyframeBoneTransforms, false, PoseLocationThreshold, PoseRotationThreshold);
+		ReplicatedPose.KeyframeSequence = ReplicatedKeyframe.Sequence;
+		ReplicatedPose.ServerTime = Time;
+		AddPoseBytes(ReplicatedPose.GetNumBytes());
+	}
+	else if (PoseReplication == EMCPoseReplication::JointAngles)
+	{
+		EncodeJointPose();
+	}
+	else
+	{
+		ReplicatedBoneTransformsTime = Time;
+		AddPoseBytes(ReplicatedBoneTransforms.Num() * (sizeof(FQuat) + 2 * sizeof(FVector)) + sizeof(float));
+	}
+}
+
+// Encode the root pose and the local finger joint rotations if any of them changed above the thresholds
+void UMCHand::EncodeJointPose()
+{
+	TArray<FQuat> JointRotations;
+	GetJointRotations(JointRotations);
+
+	// A resting hand is not sent again
+	const FTransform Root(GetComponentQuat(), GetComponentLocation());
+	const float RotationThresholdRad = FMath::DegreesToRadians(PoseRotationThreshold);
+	bool bChanged = SentJointRotations.Num() != JointRotations.Num()
+		|| !SentRoot.GetLocation().Equals(Root.GetLocation(), PoseLocationThreshold)
+		|| SentRoot.GetRotation().AngularDistance(Root.GetRotation()) > RotationThresholdRad;
+	for (int32 Idx = 0; !bChanged && Idx < JointRotations.Num(); ++Idx)
+	{
+		bChanged = SentJointRotations[Idx].AngularDistance(JointRotations[Idx]) > RotationThresholdRad;
+	}
+
+	if (bChanged)
+	{
+		SentRoot = Root;
+		SentJointRotations = JointRotations;
+		ReplicatedJointPose.Encode(Root, SentJointRotations, GetComponentSpaceTransforms().Num());
+		ReplicatedJointPose.ServerTime = GetWorld()->GetTimeSeconds();
+		AddPoseBytes(ReplicatedJointPose.GetNumBytes());
+	}
+}
+
+// Local rotations of the finger joints from the component space transforms, no bone name lookups
+void UMCHand::GetJointRotations(TArray<FQuat>& OutJointRotations) const
+{
+	const TArray<FTransform>& ComponentSpaceTransforms = GetComponentSpaceTransforms();
+	OutJointRotations.Reset(JointBoneIndices.Num());
+	for (const int32 BoneIdx : JointBoneIndices)
+	{
+		const int32 ParentIdx = BoneIndexMap->ParentIndices.IsValidIndex(BoneIdx) ? BoneIndexMap->ParentIndices[BoneIdx] : INDEX_NONE;
+		if (ComponentSpaceTransforms.IsValidIndex(BoneIdx) && ComponentSpaceTransforms.IsValidIndex(ParentIdx))
+		{
+			OutJointRotations.Add(ComponentSpaceTransforms[ParentIdx].GetRotation().Inverse() * ComponentSpaceTransforms[BoneIdx].GetRotation());
+		}
+		else
+		{
+			OutJointRotations.Add(FQuat::Identity);
+		}
+	}
+}
+
+// Estimate the hand motion from the root velocity and the joint angle deltas, and the pose update rate from it
+void UMCHand::UpdateReplicationRate(float DeltaTime)
+{
+	// Roll the bytes per second window also while nothing is sent
+	AddPoseBytes(0);
+	INC_FLOAT_STAT_BY(STAT_MCHandPoseBytesPerSecond, PoseBytesPerSecond);
+	INC_DWORD_STAT(STAT_MCReplicatedHands);
+
+	if (bShowPoseBandwidth && GEngine)
+	{
+		GEngine->AddOnScreenDebugMessage((uint64)GetUniqueID(), 0.f, FColor::Cyan,
+			FString::Printf(TEXT("%s %s: %.0f pose B/s"), *GetOwner()->GetName(), *GetName(), PoseBytesPerSecond));
+	}
+
+	if (!bAdaptiveReplication || DeltaTime <= 0.f)
+	{
+		return;
+	}
+
+	// Root speed, with the root and the fastest finger joint rotation speeds as their fingertip like displacement
+	const FTransform Root(GetComponentQuat(), GetComponentLocation());
+	TArray<FQuat> JointRotations;
+	if (BoneIndexMap.IsValid())
+	{
+		GetJointRotations(JointRotations);
+	}
+	float MaxJointAngle = 0.f;
+	for (int32 Idx = 0; Idx < JointRotations.Num() && Idx < PrevJointRotations.Num(); ++Idx)
+	{
+		MaxJointAngle = FMath::Max(MaxJointAngle, PrevJointRotations[Idx].AngularDistance(JointRotations[Idx]));
+	}
+	const float RootAngle = PrevRoot.GetRotation().AngularDistance(Root.GetRotation());
+	const float CurrentMotion = (FVector::Dist(PrevRoot.GetLocation(), Root.GetLocation())
+		+ AngularMotionScale * FMath::RadiansToDegrees(RootAngle + MaxJointAngle)) / DeltaTime;
+	PrevRoot = Root;
+	PrevJointRotations = MoveTemp(JointRotations);
+
+	// Rises right away, decays over a few frames so short pauses keep the rate
+	Motion = CurrentMotion > Motion ? CurrentMotion : FMath::FInterpTo(Motion, CurrentMotion, DeltaTime, 4.f);
+
+	// Grasps and releases are sent at the full rate
+	const bool bGrasping = (bEnableFixationGrasp && FixationGraspController->FixatedObject)
+		|| (GraspController->bContactAwareGrasp && GraspController->GetOpposingContactActor());
+	if (bGrasping != bWasGrasping)
+	{
+		bWasGrasping = bGrasping;
+		BurstTimeLeft = GraspBurstDuration;
+		GetOwner()->ForceNetUpdate();
+	}
+	BurstTimeLeft = FMath::Max(BurstTimeLeft - DeltaTime, 0.f);
+
+	const float Alpha = BurstTimeLeft > 0.f ? 1.f
+		: FMath::Clamp((Motion - IdleMotion) / FMath::Max(FullRateMotion - IdleMotion, KINDA_SMALL_NUMBER), 0.f, 1.f);
+	PoseUpdateRate = FMath::Lerp(IdlePoseUpdateRate, MaxPoseUpdateRate, Alpha);
+	NetPriorityScale = FMath::Lerp(IdleNetPriorityScale, 1.f, Alpha);
+}
+
+// Count the replicated pose payload, the bytes per second are updated once per second
+void UMCHand::AddPoseBytes(int32 InNumBytes)
+{
+	PoseBytesInWindow += InNumBytes;
+	const float Time = GetWorld()->GetTimeSeconds();
+	if (Time - PoseBytesWindowStart >= 1.f)
+	{
+		PoseBytesPerSecond = PoseBytesInWindow / (Time - PoseBytesWindowStart);
+		PoseBytesInWindow = 0;
+		PoseBytesWindowStart = Time;
+	}
+}
+
+// Rebuild the poseable mesh from the received root pose and joint rotations
+void UMCHand::OnRep_ReplicatedJointPose()
+{
+	// The local bone transforms of the poseable mesh start from the reference pose, only the joint rotations
+	// are replaced, the component space transforms are then rebuilt in one forward kinematics pass
+	TArray<FQuat> JointRotations;
+	ReplicatedJointPose.Decode(JointRotations);
+	TArray<FTransform> JointTransforms;
+	JointTransforms.Reserve(JointRotations.Num());
+	for (const FQuat& JointRotation : JointRotations)
+	{
+		JointTransforms.Add(FTransform(JointRotation));
+	}
+
+	const FTransform Root = ReplicatedJointPose.GetRoot();
+	if (bInterpolatePoses)
+	{
+		AddPoseSnapshot(ReplicatedJointPose.ServerTime, Root, JointTransforms);
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_MCReceivePose);
+	ApplyPose(Root, JointTransforms);
+}
+
+// Buffer the received bone transforms
+void UMCHand::OnRep_ReplicatedBoneTransforms()
+{
+	// The time is replicated with the arrays, the rep notifies run after all the properties of the update are received
+	if (bInterpolatePoses)
+	{
+		AddPoseSnapshot(ReplicatedBoneTransformsTime, FTransform::Identity, ReplicatedBoneTransforms);
+	}
+}
+
+// Keep the bones of the received keyframe, reapply the pose if it was decoded without its keyframe
+void UMCHand::OnRep_ReplicatedKeyframe()
+{
+	ReplicatedKeyframe.Decode(KeyframeBoneTransforms);
+	if (!bPoseOnKeyframe && ReplicatedPose.KeyframeSequence == ReplicatedKeyframe.Sequence)
+	{
+		OnRep_ReplicatedPose();
+	}
+}
+
+// Apply the received bones of the quantized pose on top of its keyframe to the poseable mesh
+void UMCHand::OnRep_ReplicatedPose()
+{
+	// Until the keyframe of the pose arrives its bones are applied over the previous ones
+	bPoseOnKeyframe = ReplicatedPose.KeyframeSequence == ReplicatedKeyframe.Sequence;
+	if (bPoseOnKeyframe && KeyframeBoneTransforms.Num() == ReceivedBoneTransforms.Num())
+	{
+		ReceivedBoneTransforms = KeyframeBoneTransforms;
+	}
+	ReplicatedPose.Decode(ReceivedBoneTransforms);
+	if (bInterpolatePoses)
+	{
+		AddPoseSnapshot(ReplicatedPose.ServerTime, ReplicatedPose.GetRoot(), ReceivedBoneTransforms);
+		return;
+	}
+
+	// Bones are relative to the root, the unchanged ones follow it
+	SCOPE_CYCLE_COUNTER(STAT_MCReceivePose);
+	ApplyPose(ReplicatedPose.GetRoot(), ReceivedBoneTransforms);
+}
+
+// Add the received pose and the current attached mesh state to the snapshot buffer
+void UMCHand::AddPoseSnapshot(double InServerTime, const FTransform& InRoot, const TArray<FTransform>& InBones)
+{
+	// Reordered updates are dropped
+	if (FMCPoseSnapshot* Snapshot = PoseSnapshots.Add(InServerTime))
+	{
+		Snapshot->Root = InRoot;
+		Snapshot->Bones = InBones;
+		Snapshot->bHasAttached = HasAttached && AttachedMesh;
+		Snapshot->AttachedTransform = AttachedTransform;
+	}
+}
+
+// Apply the root and the bone transforms of the pose replication mode to the poseable mesh
+void UMCHand::ApplyPose(const FTransform& InRoot, const TArray<FTransform>& InBones)
+{
+	// The bone space transforms are written in bulk, the pose is refreshed once
+	TArray<FTransform>& BoneSpaceTransforms = PoseableMesh->BoneSpaceTransforms;
+	if (PoseReplication == EMCPoseReplication::BoneTransforms && BoneIndexMap.IsValid())
+	{
+		// World space bone transforms, the root bones are relative to the poseable mesh
+		FMCSkeletonIndexMap::ToBoneSpace(BoneIndexMap->ParentIndices, InBones, PoseableMesh->GetComponentTransform(), BoneSpaceTransforms);
+		PoseableMesh->MarkRefreshTransformDirty();
+		return;
+	}
+
+	PoseableMesh->SetWorldLocationAndRotation(InRoot.GetLocation(), InRoot.GetRotation());
+	if (PoseReplication == EMCPoseReplication::QuantizedBones && BoneIndexMap.IsValid())
+	{
+		// Component space bone transforms, made relative to their parents
+		FMCSkeletonIndexMap::ToBoneSpace(BoneIndexMap->ParentIndices, InBones, FTransform::Identity, BoneSpaceTransforms);
+	}
+	else if (PoseReplication == EMCPoseReplication::JointAngles)
+	{
+		// Local joint rotations
+		for (int32 Idx = 0; Idx < InBones.Num() && Idx < JointBoneIndices.Num(); ++Idx)
+		{
+			if (BoneSpaceTransforms.IsValidIndex(JointBoneIndices[Idx]))
+			{
+				BoneSpaceTransforms[JointBoneIndices[Idx]].SetRotation(InBones[Idx].GetRotation());
+			}
+		}
+	}
+	PoseableMesh->MarkRefreshTransformDirty();
+}
+
+// Server time as known by the client (s)
+double UMCHand::GetServerTime() const
+{
+	const AGameStateBase* GameState = GetWorld()->GetGameState();
+	return GameState ? GameState->GetServerWorldTimeSeconds() : GetWorld()->GetTimeSeconds();
+}
+
 // Send data about current hand position and attached mesh
 void UMCHand::SendPose()
 {
-	int i = 0;
-	for (FName Name : ReplicatedBoneNames) {
-		FQuat Quat = GetBoneQuaternion(Name, EBoneSpaces::WorldSpace);
-		FVector Location = GetBoneLocation(Name, EBoneSpaces::WorldSpace);
-		FVector Scale = FVector(1, 1, 1);
-		ReplicatedBoneTransforms[i] = FTransform(Quat, Location, Scale);
-		i++;
+	SCOPE_CYCLE_COUNTER(STAT_MCSendPose);
+
+	// The quantized and joint poses are encoded when replicated
+	if (PoseReplication == EMCPoseReplication::BoneTransforms)
+	{
+		// The bone names are in bone index order, one world transform multiply per bone
+		const TArray<FTransform>& ComponentSpaceTransforms = GetComponentSpaceTransforms();
+		const FTransform& ComponentTransform = GetComponentTransform();
+		const int32 NumBones = FMath::Min(ComponentSpaceTransforms.Num(), ReplicatedBoneTransforms.Num());
+		for (int32 BoneIdx = 0; BoneIdx < NumBones; ++BoneIdx)
+		{
+			ReplicatedBoneTransforms[BoneIdx] = ComponentSpaceTransforms[BoneIdx] * ComponentTransform;
+			ReplicatedBoneTransforms[BoneIdx].SetScale3D(FVector::OneVector);
+		}
 	}
-	// Only when mesh has been attached
-	if (FixationGraspController->HasAttached)
+	// Only when mesh has been attached (the fixation controller is destroyed if disabled)
+	HasAttached = bEnableFixationGrasp && FixationGraspController->FixatedObject;
+	if (HasAttached)
 	{
 		AttachedMesh = FixationGraspController->FixatedObject;
 		AttachedTransform = AttachedMesh->GetTransform();
-		HasAttached = true;
 	}
 }
 
 // Apply data about hand position to the poseable mesh
 void UMCHand::ReceivePose()
 {
-	int i = 0;
-	for (FName Name : ReplicatedBoneNames) {
-		PoseableMesh->SetBoneTransformByName(Name, ReplicatedBoneTransforms[i], EBoneSpaces::WorldSpace);
-		i++;
+	SCOPE_CYCLE_COUNTER(STAT_MCReceivePose);
+
+	// Play back the buffered poses behind the server time, the attached mesh follows the interpolated pose
+	if (bInterpolatePoses)
+	{
+		if (PoseSnapshots.Sample(GetServerTime() - PoseInterpolationDelay, MaxPoseExtrapolation, InterpolatedPose))
+		{
+			ApplyPose(InterpolatedPose.Root, InterpolatedPose.Bones);
+			if (InterpolatedPose.bHasAttached && AttachedMesh)
+			{
+				AttachedMesh->SetActorTransform(InterpolatedPose.AttachedTransform);
+			}
+		}
+		return;
+	}
+
+	// The quantized and joint poses are applied when received
+	if (PoseReplication == EMCPoseReplication::BoneTransforms)
+	{
+		ApplyPose(FTransform::Identity, ReplicatedBoneTransforms);
 	}
 	// Only when mesh has been attached
 	// Since this ticks last we overwrite any other replication
@@ -0,0 +1,279 @@
+// Copyright 2018, Institute for Artificial Intelligence - University of Bremen
+// Author: Andrei Haidu (http://haidu.eu)
+
+#include "MCHandPose.h"
+#include "UPhysicsBasedMC.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Hand Pose Bytes (Quantized)"), STAT_MCHandPoseBytes, STATGROUP_PhysicsBasedMC);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Hand Pose Bytes (Transform Arrays)"), STAT_MCHandPoseArrayBytes, STATGROUP_PhysicsBasedMC);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Hand Pose Bones Sent"), STAT_MCHandPoseBones, STATGROUP_PhysicsBasedMC);
+
+namespace
+{
+	// Bits per component of the packed rotations
+	constexpr int32 RootRotationBits = 15;
+	constexpr int32 BoneRotationBits = 10;
+
+	// Fixed-point scale of the bone locations (1/100 cm)
+	constexpr float LocationScale = 100.f;
+
+	// Upper bound of the number of bones of a pose
+	constexpr uint32 MaxBones = 1024;
+
+	// Upper bound of the number of joints of a pose
+	constexpr uint32 MaxJoints = 64;
+
+	// The smallest three components are within [-1/sqrt(2), 1/sqrt(2)]
+	constexpr float Sqrt2 = 1.41421356f;
+
+	// Pack the rotation as the index of its largest component and the three smallest ones
+	uint64 PackQuat(FQuat InQuat, int32 InBits)
+	{
+		InQuat.Normalize();
+		const float Components[4] = { InQuat.X, InQuat.Y, InQuat.Z, InQuat.W };
+		int32 Largest = 0;
+		for (int32 Idx = 1; Idx < 4; ++Idx)
+		{
+			if (FMath::Abs(Components[Idx]) > FMath::Abs(Components[Largest]))
+			{
+				Largest = Idx;
+			}
+		}
+
+		// q and -q are the same rotation, the largest component is kept positive
+		const float Sign = Components[Largest] < 0.f ? -1.f : 1.f;
+		const uint64 MaxValue = (1ull << InBits) - 1;
+		uint64 Packed = Largest;
+		int32 Shift = 2;
+		for (int32 Idx = 0; Idx < 4; ++Idx)
+		{
+			if (Idx != Largest)
+			{
+				const float Normalized = (Components[Idx] * Sign * Sqrt2 + 1.f) * 0.5f;
+				const uint64 Value = FMath::Clamp<int64>(FMath::RoundToInt(Normalized * MaxValue), 0, MaxValue);
+				Packed |= Value << Shift;
+				Shift += InBits;
+			}
+		}
+		return Packed;
+	}
+
+	// Unpack the smallest three rotation
+	FQuat UnpackQuat(uint64 InPacked, int32 InBits)
+	{
+		const uint64 MaxValue = (1ull << InBits) - 1;
+		const int32 Largest = InPacked & 3;
+		float Components[4];
+		float SumSquares = 0.f;
+		int32 Shift = 2;
+		for (int32 Idx = 0; Idx < 4; ++Idx)
+		{
+			if (Idx != Largest)
+			{
+				const float Normalized = static_cast<float>((InPacked >> Shift) & MaxValue) / MaxValue;
+				Components[Idx] = (Normalized * 2.f - 1.f) / Sqrt2;
+				SumSquares += FMath::Square(Components[Idx]);
+				Shift += InBits;
+			}
+		}
+		Components[Largest] = FMath::Sqrt(FMath::Max(0.f, 1.f - SumSquares));
+		return FQuat(Components[0], Components[1], Components[2], Components[3]);
+	}
+
+	// Fixed-point location component
+	int16 QuantizeLocation(float InValue)
+	{
+		return static_cast<int16>(FMath::Clamp(FMath::RoundToInt(InValue * LocationScale), -MAX_int16, MAX_int16));
+	}
+}
+
+// Encode the root and all the bones as a keyframe, the keyframe transforms are set to the encoded bones,
+// otherwise the bones changed above the thresholds since the keyframe (the keyframe transforms are kept)
+void FMCQuantizedHandPose::Encode(const FTransform& InRoot, const TArray<FTransform>& InBoneTransforms, TArray<FTransform>& InOutKeyframeTransforms,
+	bool bInKeyframe, float InLocationThreshold, float InRotationThreshold)
+{
+	++Sequence;
+	RootLocation = InRoot.GetLocation();
+	RootRotation = PackQuat(InRoot.GetRotation(), RootRotationBits);
+
+	// Without a matching keyframe every bone is sent
+	const bool bAllBones = bInKeyframe || InOutKeyframeTransforms.Num() != InBoneTransforms.Num();
+	if (bInKeyframe)
+	{
+		InOutKeyframeTransforms.SetNum(InBoneTransforms.Num());
+		KeyframeSequence = Sequence;
+	}
+
+	// Bones are kept in index order, the parents are applied before their children
+	Bones.Reset();
+	const float RotationThresholdRad = FMath::DegreesToRadians(InRotationThreshold);
+	for (int32 Idx = 0; Idx < InBoneTransforms.Num() && Idx <= MAX_uint16; ++Idx)
+	{
+		const FTransform& Bone = InBoneTransforms[Idx];
+		if (bAllBones
+			|| !InOutKeyframeTransforms[Idx].GetLocation().Equals(Bone.GetLocation(), InLocationThreshold)
+			|| InOutKeyframeTransforms[Idx].GetRotation().AngularDistance(Bone.GetRotation()) > RotationThresholdRad)
+		{
+			FMCQuantizedBone& Quantized = Bones[Bones.AddUninitialized()];
+			Quantized.Index = static_cast<uint16>(Idx);
+			Quantized.Rotation = static_cast<uint32>(PackQuat(Bone.GetRotation(), BoneRotationBits));
+			Quantized.Location[0] = QuantizeLocation(Bone.GetLocation().X);
+			Quantized.Location[1] = QuantizeLocation(Bone.GetLocation().Y);
+			Quantized.Location[2] = QuantizeLocation(Bone.GetLocation().Z);
+			if (bInKeyframe)
+			{
+				InOutKeyframeTransforms[Idx] = FTransform(Bone.GetRotation(), Bone.GetLocation());
+			}
+		}
+	}
+
+	// Every update of the transform arrays sends a full transform per bone
+	INC_DWORD_STAT_BY(STAT_MCHandPoseBytes, GetNumBytes());
+	INC_DWORD_STAT_BY(STAT_MCHandPoseArrayBytes, InBoneTransforms.Num() * (sizeof(FQuat) + 2 * sizeof(FVector)));
+	INC_DWORD_STAT_BY(STAT_MCHandPoseBones, Bones.Num());
+}
+
+// Apply the encoded bones to the component space transforms
+void FMCQuantizedHandPose::Decode(TArray<FTransform>& InOutBoneTransforms) const
+{
+	for (const FMCQuantizedBone& Bone : Bones)
+	{
+		if (InOutBoneTransforms.IsValidIndex(Bone.Index))
+		{
+			InOutBoneTransforms[Bone.Index] = FTransform(
+				UnpackQuat(Bone.Rotation, BoneRotationBits),
+				FVector(Bone.Location[0], Bone.Location[1], Bone.Location[2]) / LocationScale);
+		}
+	}
+}
+
+// Root transform, without scale
+FTransform FMCQuantizedHandPose::GetRoot() const
+{
+	return FTransform(UnpackQuat(RootRotation, RootRotationBits), RootLocation);
+}
+
+// Serialize the quantized pose
+bool FMCQuantizedHandPose::NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess)
+{
+	Ar << Sequence;
+	Ar << KeyframeSequence;
+	Ar << ServerTime;
+	bOutSuccess = SerializePackedVector<100, 30>(RootLocation, Ar);
+	if (Ar.IsLoading())
+	{
+		RootRotation = 0;
+	}
+	Ar.SerializeBits(&RootRotation, 2 + 3 * RootRotationBits);
+
+	uint32 NumBones = Bones.Num();
+	Ar.SerializeIntPacked(NumBones);
+	if (Ar.IsLoading())
+	{
+		if (NumBones > MaxBones)
+		{
+			Bones.Reset();
+			bOutSuccess = false;
+			return true;
+		}
+		Bones.SetNumUninitialized(NumBones);
+	}
+
+	for (FMCQuantizedBone& Bone : Bones)
+	{
+		uint32 Index = Bone.Index;
+		Ar.SerializeIntPacked(Index);
+		Bone.Index = static_cast<uint16>(Index);
+		Ar << Bone.Rotation;
+		Ar << Bone.Location[0];
+		Ar << Bone.Location[1];
+		Ar << Bone.Location[2];
+	}
+	return true;
+}
+
+// Size on the wire, upper bound (bytes)
+int32 FMCQuantizedHandPose::GetNumBytes() const
+{
+	// Sequences, time, root location and rotation, bone count, and per bone the index, rotation and location
+	const int32 HeaderBits = 2 * 16 + 32 + 3 * 32 + 2 + 3 * RootRotationBits + 16;
+	int32 NumBits = HeaderBits;
+	for (const FMCQuantizedBone& Bone : Bones)
+	{
+		NumBits += (Bone.Index < 128 ? 8 : 16) + 32 + 3 * 16;
+	}
+	return (NumBits + 7) / 8;
+}
+
+// Encode the root and the local joint rotations, the number of mesh bones is only used for the byte stats
+void FMCJointAnglesHandPose::Encode(const FTransform& InRoot, const TArray<FQuat>& InJointRotations, int32 InNumBones)
+{
+	++Sequence;
+	RootLocation = InRoot.GetLocation();
+	RootRotation = PackQuat(InRoot.GetRotation(), RootRotationBits);
+
+	JointRotations.Reset(InJointRotations.Num());
+	for (const FQuat& JointRotation : InJointRotations)
+	{
+		JointRotations.Add(static_cast<uint32>(PackQuat(JointRotation, BoneRotationBits)));
+	}
+
+	INC_DWORD_STAT_BY(STAT_MCHandPoseBytes, GetNumBytes());
+	INC_DWORD_STAT_BY(STAT_MCHandPoseArrayBytes, InNumBones * (sizeof(FQuat) + 2 * sizeof(FVector)));
+}
+
+// Local joint rotations
+void FMCJointAnglesHandPose::Decode(TArray<FQuat>& OutJointRotations) const
+{
+	OutJointRotations.Reset(JointRotations.Num());
+	for (const uint32 JointRotation : JointRotations)
+	{
+		OutJointRotations.Add(UnpackQuat(JointRotation, BoneRotationBits));
+	}
+}
+
+// Root transform, without scale
+FTransform FMCJointAnglesHandPose::GetRoot() const
+{
+	return FTransform(UnpackQuat(RootRotation, RootRotationBits), RootLocation);
+}
+
+// Serialize the packed pose
+bool FMCJointAnglesHandPose::NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess)
+{
+	Ar << Sequence;
+	Ar << ServerTime;
+	bOutSuccess = SerializePackedVector<100, 30>(RootLocation, Ar);
+	if (Ar.IsLoading())
+	{
+		RootRotation = 0;
+	}
+	Ar.SerializeBits(&RootRotation, 2 + 3 * RootRotationBits);
+
+	uint32 NumJoints = JointRotations.Num();
+	Ar.SerializeIntPacked(NumJoints);
+	if (Ar.IsLoading())
+	{
+		if (NumJoints > MaxJoints)
+		{
+			JointRotations.Reset();
+			bOutSuccess = false;
+			return true;
+		}
+		JointRotations.SetNumUninitialized(NumJoints);
+	}
+
+	for (uint32& JointRotation : JointRotations)
+	{
+		Ar << JointRotation;
+	}
+	return true;
+}
+
+// Size on the wire, upper bound (bytes)
+int32 FMCJointAnglesHandPose::GetNumBytes() const
+{
+	// Sequence, time, root location and rotation, joint count, and the packed joint rotations
+	const int32 NumBits = 16 + 32 + 3 * 32 + 2 + 3 * RootRotationBits + 8 + JointRotations.Num() * 32;
+	return (NumBits + 7) / 8;
+}
@@ -0,0 +1,25 @@
+// Copyright 2018, Institute for Artificial Intelligence - University of Bremen
+// Author: Andrei Haidu (http://haidu.eu)
+
+#include "MCMovementControlGains.h"
+
+// Constructor, set default values (same as the movement controller)
+UMCMovementControlGains::UMCMovementControlGains()
+{
+	LocationControlType = EMCLocationControlType::Acceleration;
+	RotationControlType = EMCRotationControlType::Velocity;
+
+	LocationPIDController.P = 300.0;
+	LocationPIDController.I = 0.0f;
+	LocationPIDController.D = 55.0f;
+	LocationPIDController.MaxOutAbs = 9500.f;
+
+	RotationPIDController.P = 128.f;
+	RotationPIDController.I = 0.0f;
+	RotationPIDController.D = 0.0f;
+	RotationPIDController.MaxOutAbs = 1500.f;
+
+	bUseRotationPID = false;
+	Substeps = 1;
+	TuningCost = 0.f;
+}
@@ -2,10 +2,150 @@
 // Author: Andrei Haidu (http://haidu.eu)
 
 #include "MCMovementController6D.h"
+#include "MCMovementControllerManager.h"
+#include "MCControlPolicies.h"
+#include "MCMovementControlGains.h"
+#include "MCHand.h"
+#include "UPhysicsBasedMC.h"
+#include "Physics/PhysicsInterfaceCore.h"
+#include "IMotionController.h"
+#include "Features/IModularFeatures.h"
+#include "GameFramework/WorldSettings.h"
+#include "Misc/ScopeLock.h"
+
+DECLARE_CYCLE_STAT(TEXT("Movement Control"), STAT_MCMovementControl, STATGROUP_PhysicsBasedMC);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("MC To Physics Latency (ms)"), STAT_MCToPhysicsLatency, STATGROUP_PhysicsBasedMC);
+
+/* Control kernels */
+// Location and rotation control, specialized for every policy combination
+template<bool bSceneLocked, bool bLocationOffset, bool bRotationOffset, class TLocationPolicy, class TRotationPolicy>
+void UMCMovementController6D::ControlKernel(float InDeltaTime)
+{
+	if (TLocationPolicy::bFeedback || TRotationPolicy::bFeedback)
+	{
+		if (bSceneLocked)
+		{
+			FeedbackControl_AssumesLocked<bLocationOffset, bRotationOffset, TLocationPolicy, TRotationPolicy>(InDeltaTime);
+		}
+		else
+		{
+			// Read the pose and write the location and rotation outputs under a single scene lock
+			FPhysicsCommand::ExecuteWrite(HandBodyInstance->ActorHandle, [this, InDeltaTime](const FPhysicsActorHandle& Actor)
+			{
+				FeedbackControl_AssumesLocked<bLocationOffset, bRotationOffset, TLocationPolicy, TRotationPolicy>(InDeltaTime);
+			});
+			INC_DWORD_STAT(STAT_MCPhysicsSceneLocks);
+		}
+	}
+
+	if (TLocationPolicy::bTeleport)
+	{
+		// TeleportPhysics flag has to be set for physics based teleportation
+		HandSkelComp->SetWorldLocation(MCLocation,
+			false, (FHitResult*)nullptr, ETeleportType::TeleportPhysics);
+	}
+
+	if (TRotationPolicy::bTeleport)
+	{
+		// Teleport flag with physics has to be set since physics is enabled
+		HandSkelComp->SetWorldRotation(MCQuat * HandRotationAlignmentOffset,
+			false, (FHitResult*)nullptr, ETeleportType::TeleportPhysics);
+	}
+}
+
+// Feedback part of the control, reads the body pose and writes the outputs (physics scene has to be locked)
+template<bool bLocationOffset, bool bRotationOffset, class TLocationPolicy, class TRotationPolicy>
+void UMCMovementController6D::FeedbackControl_AssumesLocked(float InDeltaTime)
+{
+	// The components are only synced at the end of the physics frame, read the pose from the body
+	BodyTransform = HandBodyInstance->GetUnrealWorldTransform_AssumesLocked();
+
+	if (TLocationPolicy::bFeedback)
+	{
+		const FVector LocErr = MCLocation - GetControlledLocation<bLocationOffset>();
+		FVector PIDOut = LocationPIDController.Update(LocErr, InDeltaTime);
+		if (bUseFeedForward)
+		{
+			PIDOut = (PIDOut + TLocationPolicy::FeedForward_AssumesLocked(*HandBodyInstance, MCVelocity, MCAcceleration))
+				.BoundToCube(LocationPIDController.MaxOutAbs);
+		}
+		TLocationPolicy::Apply_AssumesLocked(*HandBodyInstance, PIDOut, bAllowSubstepping);
+	}
+
+	if (TRotationPolicy::bFeedback)
+	{
+		const FVector RotOut = GetRotationOutput_AssumesLocked(MCQuat * HandRotationAlignmentOffset,
+			GetControlledQuat<bRotationOffset>(), InDeltaTime);
+		TRotationPolicy::Apply_AssumesLocked(*HandBodyInstance, RotOut, bAllowSubstepping);
+	}
+}
+
+// Current location of the controlled point (hand or tracking offset)
+template<bool bLocationOffset>
+FORCEINLINE FVector UMCMovementController6D::GetControlledLocation() const
+{
+	return BodyTransform.TransformPosition(
+		(bLocationOffset ? TrackingToBodyOffset : HandToBodyOffset).GetLocation());
+}
+
+// Current rotation of the controlled point (hand or tracking offset)
+template<bool bRotationOffset>
+FORCEINLINE FQuat UMCMovementController6D::GetControlledQuat() const
+{
+	return BodyTransform.GetRotation()
+		* (bRotationOffset ? TrackingToBodyOffset : HandToBodyOffset).GetRotation();
+}
+
+// Select the kernel of the control types
+template<bool bSceneLocked, bool bLocationOffset, bool bRotationOffset>
+UMCMovementController6D::ControlKernelType UMCMovementController6D::SelectKernel() const
+{
+	switch (LocationControlType)
+	{
+	case EMCLocationControlType::Force:
+		return SelectKernelWithRotation<bSceneLocked, bLocationOffset, bRotationOffset, FMCLocationControlForce>();
+	case EMCLocationControlType::Acceleration:
+		return SelectKernelWithRotation<bSceneLocked, bLocationOffset, bRotationOffset, FMCLocationControlAcceleration>();
+	case EMCLocationControlType::Impulse:
+		return SelectKernelWithRotation<bSceneLocked, bLocationOffset, bRotationOffset, FMCLocationControlImpulse>();
+	case EMCLocationControlType::Velocity:
+		return SelectKernelWithRotation<bSceneLocked, bLocationOffset, bRotationOffset, FMCLocationControlVelocity>();
+	case EMCLocationControlType::Position:
+		return SelectKernelWithRotation<bSceneLocked, bLocationOffset, bRotationOffset, FMCLocationControlPosition>();
+	default:
+		return SelectKernelWithRotation<bSceneLocked, bLocationOffset, bRotationOffset, FMCLocationControlNone>();
+	}
+}
+
+// Select the kernel of the rotation control type with the given location policy
+template<bool bSceneLocked, bool bLocationOffset, bool bRotationOffset, class TLocationPolicy>
+UMCMovementController6D::ControlKernelType UMCMovementController6D::SelectKernelWithRotation() const
+{
+	switch (RotationControlType)
+	{
+	case EMCRotationControlType::Torque:
+		return &UMCMovementController6D::ControlKernel<bSceneLocked, bLocationOffset, bRotationOffset, TLocationPolicy, FMCRotationControlTorque>;
+	case EMCRotationControlType::Acceleration:
+		return &UMCMovementController6D::ControlKernel<bSceneLocked, bLocationOffset, bRotationOffset, TLocationPolicy, FMCRotationControlAcceleration>;
+	case EMCRotationControlType::Impulse:
+		return &UMCMovementController6D::ControlKernel<bSceneLocked, bLocationOffset, bRotationOffset, TLocationPolicy, FMCRotationControlImpulse>;
+	case EMCRotationControlType::Velocity:
+		return &UMCMovementController6D::ControlKernel<bSceneLocked, bLocationOffset, bRotationOffset, TLocationPolicy, FMCRotationControlVelocity>;
+	case EMCRotationControlType::Position:
+		return &UMCMovementController6D::ControlKernel<bSceneLocked, bLocationOffset, bRotationOffset, TLocationPolicy, FMCRotationControlPosition>;
+	default:
+		return &UMCMovementController6D::ControlKernel<bSceneLocked, bLocationOffset, bRotationOffset, TLocationPolicy, FMCRotationControlNone>;
+	}
+}
 
 // Default values of controller
 UMCMovementController6D::UMCMovementController6D()
 {
+	// Ticks only if the late update is enabled, before the physics step
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.bStartWithTickEnabled = false;
+	PrimaryComponentTick.TickGroup = TG_PrePhysics;
+
 	/* Control parameters */
 	// Movement controller location PID default parameters
 	LocationPIDController.P = 300.0;
@@ -19,8 +159,37 @@ UMCMovementController6D::UMCMovementController6D()
 	RotationPIDController.D = 0.0f;
 	RotationPIDController.MaxOutAbs = 1500.f;
 
+	// Rotation is controlled with the P term only by default
+	bUseRotationPID = false;
+
+	// Only the root body is controlled by default
+	bDistributedControl = false;
+	bControlGraspDrivenBodies = false;
+	ControlGains = nullptr;
+
 	// Use default location for tracking by default
 	bUseTrackingOffset = false;
+	bTrackingOffsetForAllControls = false;
+	bLocationTrackingOffset = false;
+	bRotationTrackingOffset = false;
+
+	// Control once per frame by default
+	bSubstepSync = false;
+	bAllowSubstepping = true;
+
+	// Update from the hand tick by default
+	bLateUpdate = false;
+	bBatchedUpdate = false;
+	MCToPhysicsLatency = 0.f;
+
+	// Follow the raw motion controller pose by default
+	bUsePosePrediction = false;
+
+	// Pure feedback control by default
+	bUseFeedForward = false;
+	FeedForwardVelocityGain = 1.f;
+	FeedForwardAccelerationGain = 1.f;
+	FeedForwardHistorySize = 4;
 	//bUseCustomBoneForTracking = false;
 	
 	//// Create tracking offset component
@@ -35,9 +204,20 @@ UMCMovementController6D::UMCMovementController6D()
 	// Default hand rotation offset
 	HandRotationAlignmentOffset = FQuat::Identity;
 
-	// Default control update function ptr
-	LocationControlFuncPtr = &UMCMovementController6D::LocationControl_None;
-	RotationControlFuncPtr = &UMCMovementController6D::RotationControl_None;
+	// Default poses
+	HandBodyInstance = nullptr;
+	HandToBodyOffset = FTransform::Identity;
+	TrackingToBodyOffset = FTransform::Identity;
+	MCLocation = FVector::ZeroVector;
+	MCQuat = FQuat::Identity;
+	MCVelocity = FVector::ZeroVector;
+	MCAcceleration = FVector::ZeroVector;
+	BodyTransform = FTransform::Identity;
+	RotationErrorIntegral = FVector::ZeroVector;
+
+	// Default control kernels
+	FrameKernel = &UMCMovementController6D::ControlKernel<false, false, false, FMCLocationControlNone, FMCRotationControlNone>;
+	SubstepKernel = &UMCMovementController6D::ControlKernel<true, false, false, FMCLocationControlNone, FMCRotationControlNone>;
 }
 
 // Init hand with the motion controllers
@@ -46,6 +226,16 @@ void UMCMovementController6D::Init(USkeletalMeshComponent* InHand, UMotionContro
 	// Set the hand skeletal mesh
 	HandSkelComp = InHand;
 
+	// Use the tuned control types and gains if available
+	if (ControlGains)
+	{
+		LocationControlType = ControlGains->LocationControlType;
+		RotationControlType = ControlGains->RotationControlType;
+		LocationPIDController = ControlGains->LocationPIDController;
+		RotationPIDController = ControlGains->RotationPIDController;
+		bUseRotationPID = ControlGains->bUseRotationPID;
+	}
+
 	// Set rotation offset of the skeletal mesh to the initial rotation
 	if (bUseTrackingOffset)
 	{
@@ -74,281 +264,418 @@ void UMCMovementController6D::Init(USkeletalMeshComponent* InHand, UMotionContro
 	// Set the motion controller pointer
 	MC = InMC;
 
+	// Controlled points of the location and the rotation control, by default only the acceleration based
+	// location control follows the tracking offset, the other controls keep following the hand
+	bLocationTrackingOffset = bUseTrackingOffset
+		&& (bTrackingOffsetForAllControls || LocationControlType == EMCLocationControlType::Acceleration);
+	bRotationTrackingOffset = bUseTrackingOffset && bTrackingOffsetForAllControls;
+
+	// Set the root body of the hand, and the offsets of the controlled poses relative to it
+	HandBodyInstance = HandSkelComp->GetBodyInstance();
+	if (HandBodyInstance)
+	{
+		const FTransform BodyTransform = HandBodyInstance->GetUnrealWorldTransform();
+		HandToBodyOffset = HandSkelComp->GetComponentTransform().GetRelativeTransform(BodyTransform);
+		TrackingToBodyOffset = GetComponentTransform().GetRelativeTransform(BodyTransform);
+	}
+
+	// Position based control teleports the whole hand, there is nothing to distribute
+	if (bDistributedControl && (LocationControlType == EMCLocationControlType::Position
+		|| RotationControlType == EMCRotationControlType::Position))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[%s] Position control cannot be distributed, controlling the root body only.."),
+			*FString(__FUNCTION__));
+		bDistributedControl = false;
+	}
+	if (bDistributedControl)
+	{
+		// The finger joint drives of the grasp controller would be fought by the reference pose targets
+		TArray<int32> GraspDrivenBoneIndices;
+		const UMCHand* Hand = Cast<UMCHand>(HandSkelComp);
+		TSharedPtr<const FMCSkeletonIndexMap> BoneIndexMap = FMCSkeletonIndexMap::Get(HandSkelComp);
+		if (!bControlGraspDrivenBodies && Hand && Hand->GetGraspController() && BoneIndexMap.IsValid())
+		{
+			Hand->GetGraspController()->GetJointBoneIndices(*BoneIndexMap, GraspDrivenBoneIndices);
+		}
+		DistributedControl.Init(HandSkelComp, BoneGainMultipliers, GraspDrivenBoneIndices);
+	}
+
+	// Position based control teleports the component, this can only be done on the game thread
+	if (bSubstepSync && (LocationControlType == EMCLocationControlType::Position
+		|| RotationControlType == EMCRotationControlType::Position))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[%s] Position control cannot run in substeps, falling back to per frame updates.."),
+			*FString(__FUNCTION__));
+		bSubstepSync = false;
+	}
+
+	// Only the force, acceleration, impulse and velocity based root body controls can be batched
+	if (bBatchedUpdate && (bDistributedControl
+		|| LocationControlType == EMCLocationControlType::NONE
+		|| LocationControlType == EMCLocationControlType::Position
+		|| RotationControlType == EMCRotationControlType::NONE
+		|| RotationControlType == EMCRotationControlType::Position))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[%s] Control type cannot be batched, falling back to individual updates.."),
+			*FString(__FUNCTION__));
+		bBatchedUpdate = false;
+	}
+
+	// The batch is updated by the manager, with its own tick and substep settings
+	if (bBatchedUpdate)
+	{
+		if (AMCMovementControllerManager* Manager = AMCMovementControllerManager::GetInstance(GetWorld()))
+		{
+			Manager->Register(this);
+			BatchManager = Manager;
+			bSubstepSync = false;
+		}
+		else
+		{
+			bBatchedUpdate = false;
+		}
+	}
+
+	// Bind the substep callback
+	if (bSubstepSync)
+	{
+		OnCalculateCustomPhysics.BindUObject(this, &UMCMovementController6D::SubstepUpdate);
+	}
+	OnCalculateLatency.BindUObject(this, &UMCMovementController6D::LatencyUpdate);
+
+	// Update before physics, after the motion controller updated its own pose (the manager ticks the batched controllers,
+	// the late update then only polls the tracker when sampling)
+	if (bLateUpdate && !bBatchedUpdate)
+	{
+		AddTickPrerequisiteComponent(MC);
+		SetComponentTickEnabled(true);
+	}
+
 	// Init PID controllers
 	LocationPIDController.Init();
 	RotationPIDController.Init();
+	RotationErrorIntegral = FVector::ZeroVector;
 
+	// Init the pose filter and the feed-forward estimation with the next sample
+	PosePredictor.Reset();
+	MCMotionHistory.Reset(FeedForwardHistorySize);
 
-	// Set location movement control type (bind to the corresponding function ptr)
-	switch (LocationControlType)
+
+	// Select the control kernels of the control types
+	SelectKernels();
+
+	if (LocationControlType == EMCLocationControlType::NONE)
 	{
-	case EMCLocationControlType::NONE:
-		LocationControlFuncPtr = &UMCMovementController6D::LocationControl_None;
-		break;
-	case EMCLocationControlType::Force:
-		LocationControlFuncPtr = &UMCMovementController6D::LocationControl_ForceBased;
-		break;
-	case EMCLocationControlType::Acceleration:
-		LocationControlFuncPtr = bUseTrackingOffset ?
-			&UMCMovementController6D::LocationControl_AccelBased_Offset : 
-			&UMCMovementController6D::LocationControl_AccelBased;
-		//LocationControlFuncPtr = &UMCMovementController6D::LocationControl_AccelBased;
-		break;
-	case EMCLocationControlType::Impulse:
-		LocationControlFuncPtr = &UMCMovementController6D::LocationControl_ImpulseBased;
-		break;
-	case EMCLocationControlType::Velocity:
-		LocationControlFuncPtr = &UMCMovementController6D::LocationControl_VelBased;
-		break;
-	case EMCLocationControlType::Position:
-		LocationControlFuncPtr = &UMCMovementController6D::LocationControl_PosBased;
-		break;
-	default:
-		LocationControlFuncPtr = &UMCMovementController6D::LocationControl_None;
-		break;
+		UE_LOG(LogTemp, Warning, TEXT("[%s] Location control OFF (None)"), *FString(__FUNCTION__));
 	}
-
-	// Set rotation movement control type (bind to the corresponding function ptr)
-	switch (RotationControlType)
+	if (RotationControlType == EMCRotationControlType::NONE)
 	{
-	case EMCRotationControlType::NONE:
-		RotationControlFuncPtr = &UMCMovementController6D::RotationControl_None;
-		break;
-	case EMCRotationControlType::Torque:
-		RotationControlFuncPtr = &UMCMovementController6D::RotationControl_TorqueBased;
-		break;
-	case EMCRotationControlType::Acceleration:
-		RotationControlFuncPtr = &UMCMovementController6D::RotationControl_AccelBased;
-		break;
-	case EMCRotationControlType::Impulse:
-		RotationControlFuncPtr = &UMCMovementController6D::RotationControl_ImpulseBased;
-		break;
-	case EMCRotationControlType::Velocity:
-		RotationControlFuncPtr = bUseTrackingOffset ?
-			&UMCMovementController6D::RotationControl_VelBased/*_Offset */: // Offset does not seem to be relevant for rotation
-			&UMCMovementController6D::RotationControl_VelBased;
-		//RotationControlFuncPtr = &UMCMovementController6D::RotationControl_VelBased;
-		break;
-	case EMCRotationControlType::Position:
-		RotationControlFuncPtr = &UMCMovementController6D::RotationControl_PosBased;
-		break;
-	default:
-		RotationControlFuncPtr = &UMCMovementController6D::RotationControl_None;
-		break;
+		UE_LOG(LogTemp, Warning, TEXT("[%s] Rotation control OFF (None)"), *FString(__FUNCTION__));
 	}
 }
 
-// Update the movement
-void UMCMovementController6D::Update(const float DeltaTime)
+// Select the frame and substep kernels of the control types and the controlled points
+void UMCMovementController6D::SelectKernels()
 {
-	// Call the movement control functions
-	(this->*LocationControlFuncPtr)(DeltaTime);
-	(this->*RotationControlFuncPtr)(DeltaTime);
+	if (bRotationTrackingOffset)
+	{
+		FrameKernel = SelectKernel<false, true, true>();
+		SubstepKernel = SelectKernel<true, true, true>();
+	}
+	else if (bLocationTrackingOffset)
+	{
+		FrameKernel = SelectKernel<false, true, false>();
+		SubstepKernel = SelectKernel<true, true, false>();
+	}
+	else
+	{
+		FrameKernel = SelectKernel<false, false, false>();
+		SubstepKernel = SelectKernel<true, false, false>();
+	}
 }
 
-// Location interaction functions types
-void UMCMovementController6D::LocationControl_None(float InDeltaTime)
+// Called when actor removed from game or game ended
+void UMCMovementController6D::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
-	UE_LOG(LogTemp, Warning, TEXT("Location control OFF (None)"));
+	Super::EndPlay(EndPlayReason);
+
+	if (AMCMovementControllerManager* Manager = BatchManager.Get())
+	{
+		Manager->Unregister(this);
+	}
+	BatchManager.Reset();
 }
 
-void UMCMovementController6D::LocationControl_ForceBased(float InDeltaTime)
+// Called every frame if the late update is enabled
+void UMCMovementController6D::TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
 {
-	const FVector LocErr = MC->GetComponentLocation() - HandSkelComp->GetComponentLocation();
-	const FVector PIDOut = LocationPIDController.Update(LocErr, InDeltaTime);
-	HandSkelComp->AddForce(PIDOut);
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
 
-	//AddForceToAllBodiesBelow(PIDOut);
-	//UE_LOG(LogTemp, Warning, TEXT("[%s] PIDOut=%s"),
-	//	*FString(__FUNCTION__), *PIDOut.ToString());
+	Update(DeltaTime);
 }
 
-void UMCMovementController6D::LocationControl_ImpulseBased(float InDeltaTime)
+// Update the movement
+void UMCMovementController6D::Update(const float DeltaTime)
 {
-	const FVector LocErr = MC->GetComponentLocation() - HandSkelComp->GetComponentLocation();
-	const FVector PIDOut = LocationPIDController.Update(LocErr, InDeltaTime);
-	HandSkelComp->AddImpulse(PIDOut, NAME_None, true); // mass will have no effect
-
-	//AddImpulse(PIDOut);
-	//AddImpulseToAllBodiesBelow(PIDOut, NAME_None, true); // mass will have no effect
-	//AddImpulseToAllBodiesBelow(PIDOut);
-	//UE_LOG(LogTemp, Warning, TEXT("[%s] PIDOut=%s"),
-	//	*FString(__FUNCTION__), *PIDOut.ToString());
-}
+	SCOPE_CYCLE_COUNTER(STAT_MCMovementControl);
 
-void UMCMovementController6D::LocationControl_AccelBased(float InDeltaTime)
-{
-	const FVector LocErr = MC->GetComponentLocation() - HandSkelComp->GetComponentLocation();
-	const FVector PIDOut = LocationPIDController.Update(LocErr, InDeltaTime);
-	HandSkelComp->AddForce(PIDOut, NAME_None, true); // Acceleration based (mass will have no effect)
+	// Sample the target pose on the game thread, the substeps reuse it
+	SampleMotionController();
 
-	//AddForceToAllBodiesBelow(PIDOut, NAME_None, true); // Mass will have no effect
-	//UE_LOG(LogTemp, Warning, TEXT("[%s] PIDOut=%s"),
-	//	*FString(__FUNCTION__), *PIDOut.ToString());
-}
+	// The body instance can change if the physics state of the hand is recreated
+	HandBodyInstance = HandSkelComp->GetBodyInstance();
+	if (!HandBodyInstance)
+	{
+		return;
+	}
+	if (bDistributedControl)
+	{
+		DistributedControl.RefreshBodies(HandSkelComp);
+	}
 
-void UMCMovementController6D::LocationControl_AccelBased_Offset(float InDeltaTime)
-{
-	//const FVector LocErr = MC->GetComponentLocation() - HandSkelComp->GetBoneLocation(CustomBoneFName);
-	const FVector LocErr = MC->GetComponentLocation() - GetComponentLocation();
-	const FVector PIDOut = LocationPIDController.Update(LocErr, InDeltaTime);
-	HandSkelComp->AddForce(PIDOut, NAME_None, true); // Acceleration based (mass will have no effect)	
-
-	//AddForceToAllBodiesBelow(PIDOut, NAME_None, true); // Mass will have no effect
-	//UE_LOG(LogTemp, Warning, TEXT("[%s] PIDOut=%s"),
-	//	*FString(__FUNCTION__), *PIDOut.ToString());
+	if (bSubstepSync)
+	{
+		// The control functions will be called from the physics scene with the substep delta time
+		HandBodyInstance->AddCustomPhysics(OnCalculateCustomPhysics);
+	}
+	else
+	{
+		ReadMotionControllerSample();
+		bAllowSubstepping = true;
+
+		if (bDistributedControl)
+		{
+			// Read and write all the bodies under a single scene lock
+			FPhysicsCommand::ExecuteWrite(HandBodyInstance->ActorHandle, [this, DeltaTime](const FPhysicsActorHandle& Actor)
+			{
+				DistributedUpdate_AssumesLocked(DeltaTime);
+			});
+			INC_DWORD_STAT(STAT_MCPhysicsSceneLocks);
+		}
+		else
+		{
+			// Call the movement control kernel
+			(this->*FrameKernel)(DeltaTime);
+		}
+
+#if STATS
+		// The outputs are consumed by the next physics step
+		HandBodyInstance->AddCustomPhysics(OnCalculateLatency);
+#endif //STATS
+	}
 }
 
-void UMCMovementController6D::LocationControl_VelBased(float InDeltaTime)
+// Called by the physics scene in every substep
+void UMCMovementController6D::SubstepUpdate(float DeltaTime, FBodyInstance* InBodyInstance)
 {
-	const FVector LocErr = MC->GetComponentLocation() - HandSkelComp->GetComponentLocation();
-	const FVector PIDOut = LocationPIDController.Update(LocErr, InDeltaTime);
-	HandSkelComp->SetPhysicsLinearVelocity(PIDOut);
-
-	//SetAllPhysicsLinearVelocity(PIDOut);
-	//UE_LOG(LogTemp, Warning, TEXT("[%s] MCLoc=%s, Loc=%s, PIDOut=%s, CompVel=%s"),
-	//	*FString(__FUNCTION__),
-	//	*MC->GetComponentLocation().ToString(),
-	//	*GetComponentLocation().ToString(),
-	//	*PIDOut.ToString(),
-	//	*ComponentVelocity.ToString());
-}
+	SCOPE_CYCLE_COUNTER(STAT_MCMovementControl);
 
-void UMCMovementController6D::LocationControl_PosBased(float InDeltaTime)
-{
-	// TeleportPhysics flag has to be set for physics based teleportation
-	HandSkelComp->SetWorldLocation(MC->GetComponentLocation(),
-		false, (FHitResult*)nullptr, ETeleportType::TeleportPhysics);
-	//SetAllPhysicsPosition(MC->GetComponentLocation());
+	ReadMotionControllerSample();
+	RecordMCToPhysicsLatency();
+
+	// Forces are applied only for the current substep
+	bAllowSubstepping = false;
+
+	if (bDistributedControl)
+	{
+		DistributedUpdate_AssumesLocked(DeltaTime);
+	}
+	else
+	{
+		// Call the movement control kernel
+		(this->*SubstepKernel)(DeltaTime);
+	}
 }
 
-// Rotation interaction functions types
-void UMCMovementController6D::RotationControl_None(float InDeltaTime)
+// Called by the physics scene when the per frame control outputs are applied
+void UMCMovementController6D::LatencyUpdate(float DeltaTime, FBodyInstance* InBodyInstance)
 {
-	UE_LOG(LogTemp, Warning, TEXT("Rotation control OFF (None)"));
+	RecordMCToPhysicsLatency();
 }
 
-void UMCMovementController6D::RotationControl_TorqueBased(float InDeltaTime)
+// Sample the motion controller pose and hand it over to the physics step
+void UMCMovementController6D::SampleMotionController()
 {
-	const FQuat TargetQuat = MC->GetComponentQuat() * HandRotationAlignmentOffset;
-	FQuat CompQuat = HandSkelComp->GetComponentQuat();
+	FVector Location;
+	FQuat Quat;
 
-	// Check if cos theta from the dot product is negative,
-	// avoids taking the long path around the sphere
-	const float CosTheta = TargetQuat | CompQuat;
-	if (CosTheta < 0)
+	// Without the late update (or without a tracking system) use the pose of the motion controller component
+	if (!bLateUpdate || !PollMotionController(Location, Quat))
 	{
-		CompQuat *= -1.f;
+		Location = MC->GetComponentLocation();
+		Quat = MC->GetComponentQuat();
 	}
+	const double SampleTime = FPlatformTime::Seconds();
 
-	// Use XYZ from the Quaternion as output
-	const FQuat QuatOut = TargetQuat * CompQuat.Inverse();
-	const FVector RotOut = FVector(QuatOut.X, QuatOut.Y, QuatOut.Z)
-		* RotationPIDController.P; // PID P is used as gain
+	// Filter the sample and extrapolate it, the sample time is only written from here (game thread)
+	if (bUsePosePrediction)
+	{
+		PosePredictor.Update(Location, Quat, SampleTime - LatestSample.Time);
+	}
 
-	HandSkelComp->AddTorqueInRadians(RotOut);
+	// Feed-forward terms from the raw sample or from the filter
+	FVector Velocity = FVector::ZeroVector;
+	FVector Acceleration = FVector::ZeroVector;
+	if (bUseFeedForward)
+	{
+		EstimateFeedForward(Location, SampleTime, Velocity, Acceleration);
+	}
 
-	// PID Version
-	//const FRotator RotErr = MC->GetComponentRotation() - GetComponentRotation();
-	//const FVector PIDOut = RotationPIDController.Update(RotErr.Vector(), InDeltaTime);
-	//AddTorqueInRadians(RotOut); 
+	if (bUsePosePrediction)
+	{
+		PosePredictor.GetPredictedPose(Location, Quat);
+	}
+
+	FScopeLock Lock(&SampleCriticalSection);
+	LatestSample.Location = Location;
+	LatestSample.Quat = Quat;
+	LatestSample.Velocity = Velocity;
+	LatestSample.Acceleration = Acceleration;
+	LatestSample.Time = SampleTime;
+	LatestSample.bApplied = false;
 }
 
-void UMCMovementController6D::RotationControl_AccelBased(float InDeltaTime)
+// Poll the tracking system directly for the freshest motion controller pose
+bool UMCMovementController6D::PollMotionController(FVector& OutLocation, FQuat& OutQuat) const
 {
-	const FQuat TargetQuat = MC->GetComponentQuat() * HandRotationAlignmentOffset;
-	FQuat CompQuat = HandSkelComp->GetComponentQuat();
+	UWorld* World = GetWorld();
+	const float WorldToMetersScale = World && World->GetWorldSettings() ?
+		World->GetWorldSettings()->WorldToMeters : 100.f;
 
-	// Check if cos theta from the dot product is negative,
-	// avoids taking the long path around the sphere
-	const float CosTheta = TargetQuat | CompQuat;
-	if (CosTheta < 0)
+	TArray<IMotionController*> MotionControllers = IModularFeatures::Get().GetModularFeatureImplementations<IMotionController>(
+		IMotionController::GetModularFeatureName());
+	for (IMotionController* MotionController : MotionControllers)
 	{
-		CompQuat *= -1.f;
+		FRotator TrackedRotation;
+		FVector TrackedLocation;
+		if (MotionController && MotionController->GetControllerOrientationAndPosition(
+			MC->PlayerIndex, MC->MotionSource, TrackedRotation, TrackedLocation, WorldToMetersScale))
+		{
+			// The tracked pose is relative to the tracking origin (parent of the motion controller)
+			const FTransform TrackedTransform(TrackedRotation, TrackedLocation);
+			const FTransform WorldTransform = MC->GetAttachParent() ?
+				TrackedTransform * MC->GetAttachParent()->GetComponentTransform() : TrackedTransform;
+			OutLocation = WorldTransform.GetLocation();
+			OutQuat = WorldTransform.GetRotation();
+			return true;
+		}
 	}
-
-	// Use XYZ from the Quaternion as output
-	const FQuat QuatOut = TargetQuat * CompQuat.Inverse();
-	const FVector RotOut = FVector(QuatOut.X, QuatOut.Y, QuatOut.Z)
-		* RotationPIDController.P; // PID P is used as gain
-
-	HandSkelComp->AddTorqueInRadians(RotOut, NAME_None, true); // Acceleration based (mass will have no effect) 
-
-	// PID Version
-	//const FRotator RotErr = MC->GetComponentRotation() - GetComponentRotation();
-	//const FVector PIDOut = RotationPIDController.Update(RotErr.Vector(), InDeltaTime);
-	//AddTorqueInRadians(RotOut, NAME_None, true)); // Acceleration based (mass will have no effect) 
+	return false;
 }
 
-void UMCMovementController6D::RotationControl_ImpulseBased(float InDeltaTime)
+// Read the latest motion controller sample into the control target
+void UMCMovementController6D::ReadMotionControllerSample()
 {
-	// TODO
-	UE_LOG(LogTemp, Warning, TEXT("Rotation Control AccelBased"));
+	FScopeLock Lock(&SampleCriticalSection);
+	MCLocation = LatestSample.Location;
+	MCQuat = LatestSample.Quat;
+	MCVelocity = LatestSample.Velocity;
+	MCAcceleration = LatestSample.Acceleration;
 }
 
-void UMCMovementController6D::RotationControl_VelBased(float InDeltaTime)
+// Estimate the feed-forward velocity and acceleration of the motion controller
+void UMCMovementController6D::EstimateFeedForward(const FVector& InLocation, double InTime, FVector& OutVelocity, FVector& OutAcceleration)
 {
-	const FQuat TargetQuat = MC->GetComponentQuat() * HandRotationAlignmentOffset;	
-	FQuat CompQuat = HandSkelComp->GetComponentQuat();
+	// Finite differences over the latest raw samples
+	MCMotionHistory.Add(InLocation, InTime);
+	if (!MCMotionHistory.Estimate(OutVelocity, OutAcceleration))
+	{
+		OutVelocity = FVector::ZeroVector;
+		OutAcceleration = FVector::ZeroVector;
+	}
 
-	// Check if cos theta from the dot product is negative,
-	// avoids taking the long path around the sphere
-	const float CosTheta = TargetQuat | CompQuat;
-	if (CosTheta < 0)
+	// The filtered estimates are smoother, use them if available
+	if (bUsePosePrediction)
 	{
-		CompQuat *= -1.f;
+		OutVelocity = PosePredictor.GetLinearVelocity();
+		if (PosePredictor.bEstimateAcceleration)
+		{
+			OutAcceleration = PosePredictor.GetLinearAcceleration();
+		}
 	}
 
-	// Use XYZ from the Quaternion as output
-	const FQuat QuatOut = TargetQuat * CompQuat.Inverse();
-	const FVector RotOut = FVector(QuatOut.X, QuatOut.Y, QuatOut.Z)
-		* RotationPIDController.P; // PID P is used as gain
+	OutVelocity *= FeedForwardVelocityGain;
+	OutAcceleration *= FeedForwardAccelerationGain;
+}
 
-	HandSkelComp->SetPhysicsAngularVelocityInRadians(RotOut);
-	//SetAllPhysicsAngularVelocityInRadians(RotOut);
+// Location feed-forward term of the location control type (physics scene has to be locked)
+FVector UMCMovementController6D::GetLocationFeedForward_AssumesLocked() const
+{
+	if (!bUseFeedForward || !HandBodyInstance)
+	{
+		return FVector::ZeroVector;
+	}
 
-	// PID Version
-	//const FRotator RotErr = MC->GetComponentRotation() - GetComponentRotation();
-	//const FVector PIDOut = RotationPIDController.Update(RotErr.Vector(), InDeltaTime);
-	//SetPhysicsAngularVelocityInRadians(PIDOut);
-	////SetAllPhysicsAngularVelocityInRadians(PIDOut);	
+	switch (LocationControlType)
+	{
+	case EMCLocationControlType::Force:
+		return FMCLocationControlForce::FeedForward_AssumesLocked(*HandBodyInstance, MCVelocity, MCAcceleration);
+	case EMCLocationControlType::Acceleration:
+		return FMCLocationControlAcceleration::FeedForward_AssumesLocked(*HandBodyInstance, MCVelocity, MCAcceleration);
+	case EMCLocationControlType::Velocity:
+		return FMCLocationControlVelocity::FeedForward_AssumesLocked(*HandBodyInstance, MCVelocity, MCAcceleration);
+	default:
+		return FVector::ZeroVector;
+	}
 }
 
-void UMCMovementController6D::RotationControl_VelBased_Offset(float InDeltaTime)
+// Control all the bodies of the hand (physics scene has to be locked)
+void UMCMovementController6D::DistributedUpdate_AssumesLocked(float InDeltaTime)
 {
-	const FQuat TargetQuat = MC->GetComponentQuat() * HandRotationAlignmentOffset;
-	FQuat CompQuat = GetComponentQuat();
-	/*FQuat CompQuat = HandSkelComp->GetBoneQuaternion(CustomBoneFName);*/
-	
-	// Check if cos theta from the dot product is negative,
-	// avoids taking the long path around the sphere
-	const float CosTheta = TargetQuat | CompQuat;
-	if (CosTheta < 0)
+	// Target of the root body from the target of the controlled point
+	const FTransform& ControlledToBodyOffset = bUseTrackingOffset ? TrackingToBodyOffset : HandToBodyOffset;
+	const FTransform RootTarget = ControlledToBodyOffset.Inverse() * FTransform(MCQuat * HandRotationAlignmentOffset, MCLocation);
+
+	// The force feed-forward accelerates the whole hand
+	FVector LocationFeedForward = FVector::ZeroVector;
+	if (bUseFeedForward)
 	{
-		CompQuat *= -1.f;
+		switch (LocationControlType)
+		{
+		case EMCLocationControlType::Force:
+			LocationFeedForward = MCAcceleration * DistributedControl.GetTotalMass();
+			break;
+		case EMCLocationControlType::Acceleration:
+			LocationFeedForward = MCAcceleration;
+			break;
+		case EMCLocationControlType::Velocity:
+			LocationFeedForward = MCVelocity;
+			break;
+		default:
+			break;
+		}
 	}
 
-	// Use XYZ from the Quaternion as output
-	const FQuat QuatOut = TargetQuat * CompQuat.Inverse();
-	const FVector RotOut = FVector(QuatOut.X, QuatOut.Y, QuatOut.Z)
-		* RotationPIDController.P; // PID P is used as gain
+	DistributedControl.ReadBodyPoses_AssumesLocked(bUseRotationPID);
+	DistributedControl.Evaluate(RootTarget,
+		LocationPIDController.P, LocationPIDController.I, LocationPIDController.D, LocationPIDController.MaxOutAbs,
+		bUseRotationPID, RotationPIDController.P, RotationPIDController.I, RotationPIDController.D, RotationPIDController.MaxOutAbs,
+		InDeltaTime);
+	DistributedControl.WriteOutputs_AssumesLocked(LocationControlType, RotationControlType, LocationFeedForward, bAllowSubstepping);
+}
 
-	HandSkelComp->SetPhysicsAngularVelocityInRadians(RotOut);
-	//SetAllPhysicsAngularVelocityInRadians(RotOut);
+// Rotation control output, P only or full PID (physics scene has to be locked)
+FVector UMCMovementController6D::GetRotationOutput_AssumesLocked(const FQuat& InTargetQuat, const FQuat& InCurrQuat, float InDeltaTime)
+{
+	if (bUseRotationPID)
+	{
+		return MCRotationPIDUpdate(RotationErrorIntegral, MCRotationErrorAxisAngle(InTargetQuat, InCurrQuat),
+			HandBodyInstance->GetUnrealWorldAngularVelocityInRadians_AssumesLocked(), InDeltaTime,
+			RotationPIDController.P, RotationPIDController.I, RotationPIDController.D, RotationPIDController.MaxOutAbs);
+	}
 
-	// PID Version
-	//const FRotator RotErr = MC->GetComponentRotation() - GetComponentRotation();
-	//const FVector PIDOut = RotationPIDController.Update(RotErr.Vector(), InDeltaTime);
-	//SetPhysicsAngularVelocityInRadians(PIDOut);
-	////SetAllPhysicsAngularVelocityInRadians(PIDOut);	
+	// Use XYZ from the Quaternion as output, PID P is used as gain
+	return MCRotationError(InTargetQuat, InCurrQuat) * RotationPIDController.P;
 }
 
-void UMCMovementController6D::RotationControl_PosBased(float InDeltaTime)
+// Measure the latency at the first physics application of the latest sample
+void UMCMovementController6D::RecordMCToPhysicsLatency()
 {
-	// Teleport flag with physics has to be set since physics is enabled
-	HandSkelComp->SetWorldRotation(MC->GetComponentQuat() * HandRotationAlignmentOffset,
-		false, (FHitResult*)nullptr, ETeleportType::TeleportPhysics);
-	//SetAllPhysicsRotation(MC->GetComponentQuat() * HandRotationAlignmentOffset);
+	FScopeLock Lock(&SampleCriticalSection);
+	if (!LatestSample.bApplied)
+	{
+		LatestSample.bApplied = true;
+		MCToPhysicsLatency = (FPlatformTime::Seconds() - LatestSample.Time) * 1000.0;
+		SET_FLOAT_STAT(STAT_MCToPhysicsLatency, MCToPhysicsLatency);
+	}
 }
-
-
@@ -0,0 +1,319 @@
+// Copyright 2018, Institute for Artificial Intelligence - University of Bremen
+// Author: Andrei Haidu (http://haidu.eu)
+
+#include "MCMovementControllerManager.h"
+#include "MCControlPolicies.h"
+#include "UPhysicsBasedMC.h"
+#include "EngineUtils.h"
+#include "PhysicsPublic.h"
+#include "Physics/PhysicsInterfaceCore.h"
+#include "Async/ParallelFor.h"
+
+DECLARE_CYCLE_STAT(TEXT("Batched Movement Control"), STAT_MCBatchedMovementControl, STATGROUP_PhysicsBasedMC);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Batched Movement Controllers"), STAT_MCBatchedMovementControllers, STATGROUP_PhysicsBasedMC);
+
+// Sets default values
+AMCMovementControllerManager::AMCMovementControllerManager()
+{
+	// Tick before physics
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.TickGroup = TG_PrePhysics;
+
+	bSubstepSync = false;
+	MinParallelBatchSize = 8;
+}
+
+// Get the manager of the world, spawn one if none is available
+AMCMovementControllerManager* AMCMovementControllerManager::GetInstance(UWorld* InWorld)
+{
+	if (!InWorld)
+	{
+		return nullptr;
+	}
+
+	for (TActorIterator<AMCMovementControllerManager> Itr(InWorld); Itr; ++Itr)
+	{
+		return *Itr;
+	}
+
+	return InWorld->SpawnActor<AMCMovementControllerManager>();
+}
+
+// Called every frame, before physics
+void AMCMovementControllerManager::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	SCOPE_CYCLE_COUNTER(STAT_MCBatchedMovementControl);
+	SET_DWORD_STAT(STAT_MCBatchedMovementControllers, Controllers.Num());
+
+	if (Controllers.Num() == 0)
+	{
+		return;
+	}
+
+	// Sample the motion controllers, and refresh the bodies (can change if the physics state is recreated)
+	for (int32 Idx = 0; Idx < Controllers.Num(); ++Idx)
+	{
+		UMCMovementController6D* Controller = Controllers[Idx];
+		Controller->SampleMotionController();
+		Controller->ReadMotionControllerSample();
+		TargetLocations[Idx] = Controller->MCLocation;
+		TargetQuats[Idx] = Controller->MCQuat;
+		Bodies[Idx] = Controller->HandSkelComp->GetBodyInstance();
+		Controller->HandBodyInstance = Bodies[Idx];
+		ReadGains(Idx);
+	}
+
+	if (bSubstepSync)
+	{
+		// Any of the bodies can carry the callback, the whole batch is updated from the first valid one
+		if (FBodyInstance* const* Body = Bodies.FindByPredicate([](const FBodyInstance* InBody) { return InBody != nullptr; }))
+		{
+			(*Body)->AddCustomPhysics(OnCalculateCustomPhysics);
+		}
+	}
+	else if (FPhysScene* PhysScene = GetWorld()->GetPhysicsScene())
+	{
+		// Read the poses and write the outputs of the whole batch under a single scene lock,
+		// the evaluation in between does not touch the physics scene
+		FPhysicsCommand::ExecuteWrite(PhysScene, [this, DeltaTime]()
+		{
+			ReadBodyPoses_AssumesLocked();
+			Evaluate(DeltaTime);
+			WriteOutputs_AssumesLocked(true);
+		});
+		INC_DWORD_STAT(STAT_MCPhysicsSceneLocks);
+	}
+}
+
+// Add the controller to the batch
+void AMCMovementControllerManager::Register(UMCMovementController6D* InController)
+{
+	if (!InController || Controllers.Contains(InController))
+	{
+		return;
+	}
+
+	// The whole batch runs in substeps if any of the controllers requires it
+	bSubstepSync |= InController->bSubstepSync;
+	if (bSubstepSync && !OnCalculateCustomPhysics.IsBound())
+	{
+		OnCalculateCustomPhysics.BindUObject(this, &AMCMovementControllerManager::SubstepUpdate);
+	}
+
+	// Sample the motion controllers after they updated their own pose
+	if (InController->MC)
+	{
+		AddTickPrerequisiteComponent(InController->MC);
+	}
+
+	Controllers.Emplace(InController);
+	Bodies.Emplace(InController->HandBodyInstance);
+	LocationControlTypes.Emplace(InController->LocationControlType);
+	RotationControlTypes.Emplace(InController->RotationControlType);
+
+	// Controlled points of the hand
+	LocationToBodyOffsets.Emplace(InController->bLocationTrackingOffset ?
+		InController->TrackingToBodyOffset : InController->HandToBodyOffset);
+	RotationToBodyOffsets.Emplace(InController->bRotationTrackingOffset ?
+		InController->TrackingToBodyOffset : InController->HandToBodyOffset);
+	RotationAlignmentOffsets.Emplace(InController->HandRotationAlignmentOffset);
+
+	TargetLocations.Emplace(FVector::ZeroVector);
+	TargetQuats.Emplace(FQuat::Identity);
+	LocationFeedForwards.Emplace(FVector::ZeroVector);
+	Locations.Emplace(FVector::ZeroVector);
+	Quats.Emplace(FQuat::Identity);
+	AngularVelocities.Emplace(FVector::ZeroVector);
+
+	LocationP.Emplace(0.f);
+	LocationI.Emplace(0.f);
+	LocationD.Emplace(0.f);
+	LocationMaxOutAbs.Emplace(0.f);
+	RotationPIDEnabled.Emplace(false);
+	RotationP.Emplace(0.f);
+	RotationI.Emplace(0.f);
+	RotationD.Emplace(0.f);
+	RotationMaxOutAbs.Emplace(0.f);
+	ReadGains(Controllers.Num() - 1);
+
+	LocationPrevErrors.Emplace(FVector::ZeroVector);
+	LocationIntegrals.Emplace(FVector::ZeroVector);
+	RotationIntegrals.Emplace(FVector::ZeroVector);
+
+	LocationOutputs.Emplace(FVector::ZeroVector);
+	RotationOutputs.Emplace(FVector::ZeroVector);
+}
+
+// Remove the controller from the batch
+void AMCMovementControllerManager::Unregister(UMCMovementController6D* InController)
+{
+	const int32 Idx = Controllers.Find(InController);
+	if (Idx == INDEX_NONE)
+	{
+		return;
+	}
+
+	if (InController->MC)
+	{
+		RemoveTickPrerequisiteComponent(InController->MC);
+	}
+
+	Controllers.RemoveAtSwap(Idx);
+	Bodies.RemoveAtSwap(Idx);
+	LocationControlTypes.RemoveAtSwap(Idx);
+	RotationControlTypes.RemoveAtSwap(Idx);
+	LocationToBodyOffsets.RemoveAtSwap(Idx);
+	RotationToBodyOffsets.RemoveAtSwap(Idx);
+	RotationAlignmentOffsets.RemoveAtSwap(Idx);
+	TargetLocations.RemoveAtSwap(Idx);
+	TargetQuats.RemoveAtSwap(Idx);
+	LocationFeedForwards.RemoveAtSwap(Idx);
+	Locations.RemoveAtSwap(Idx);
+	Quats.RemoveAtSwap(Idx);
+	AngularVelocities.RemoveAtSwap(Idx);
+	LocationP.RemoveAtSwap(Idx);
+	LocationI.RemoveAtSwap(Idx);
+	LocationD.RemoveAtSwap(Idx);
+	LocationMaxOutAbs.RemoveAtSwap(Idx);
+	RotationPIDEnabled.RemoveAtSwap(Idx);
+	RotationP.RemoveAtSwap(Idx);
+	RotationI.RemoveAtSwap(Idx);
+	RotationD.RemoveAtSwap(Idx);
+	RotationMaxOutAbs.RemoveAtSwap(Idx);
+	LocationPrevErrors.RemoveAtSwap(Idx);
+	LocationIntegrals.RemoveAtSwap(Idx);
+	RotationIntegrals.RemoveAtSwap(Idx);
+	LocationOutputs.RemoveAtSwap(Idx);
+	RotationOutputs.RemoveAtSwap(Idx);
+}
+
+// Copy the current PID gains of the controller, runtime changes of the controller gains are picked up every frame
+void AMCMovementControllerManager::ReadGains(int32 Idx)
+{
+	const UMCMovementController6D* Controller = Controllers[Idx];
+	LocationP[Idx] = Controller->LocationPIDController.P;
+	LocationI[Idx] = Controller->LocationPIDController.I;
+	LocationD[Idx] = Controller->LocationPIDController.D;
+	LocationMaxOutAbs[Idx] = Controller->LocationPIDController.MaxOutAbs;
+	RotationPIDEnabled[Idx] = Controller->bUseRotationPID;
+	RotationP[Idx] = Controller->RotationPIDController.P;
+	RotationI[Idx] = Controller->RotationPIDController.I;
+	RotationD[Idx] = Controller->RotationPIDController.D;
+	RotationMaxOutAbs[Idx] = Controller->RotationPIDController.MaxOutAbs;
+}
+
+// Called by the physics scene in every substep, the scene is already locked
+void AMCMovementControllerManager::SubstepUpdate(float DeltaTime, FBodyInstance* InBodyInstance)
+{
+	SCOPE_CYCLE_COUNTER(STAT_MCBatchedMovementControl);
+
+	ReadBodyPoses_AssumesLocked();
+	Evaluate(DeltaTime);
+	WriteOutputs_AssumesLocked(false);
+}
+
+// Read the poses and the feed-forward terms of all the bodies (physics scene has to be locked)
+void AMCMovementControllerManager::ReadBodyPoses_AssumesLocked()
+{
+	for (int32 Idx = 0; Idx < Bodies.Num(); ++Idx)
+	{
+		if (FBodyInstance* Body = Bodies[Idx])
+		{
+			const FTransform BodyTransform = Body->GetUnrealWorldTransform_AssumesLocked();
+			Locations[Idx] = (LocationToBodyOffsets[Idx] * BodyTransform).GetLocation();
+			Quats[Idx] = (RotationToBodyOffsets[Idx] * BodyTransform).GetRotation();
+			if (RotationPIDEnabled[Idx])
+			{
+				AngularVelocities[Idx] = Body->GetUnrealWorldAngularVelocityInRadians_AssumesLocked();
+			}
+			LocationFeedForwards[Idx] = Controllers[Idx]->GetLocationFeedForward_AssumesLocked();
+		}
+	}
+}
+
+// Compute the control outputs of all the controllers
+void AMCMovementControllerManager::Evaluate(float DeltaTime)
+{
+	if (DeltaTime <= 0.f)
+	{
+		return;
+	}
+	const float InvDeltaTime = 1.f / DeltaTime;
+
+	ParallelFor(Controllers.Num(), [&](int32 Idx)
+	{
+		// Location PID
+		const FVector LocErr = TargetLocations[Idx] - Locations[Idx];
+		LocationIntegrals[Idx] += LocErr * DeltaTime;
+		const FVector LocDErr = (LocErr - LocationPrevErrors[Idx]) * InvDeltaTime;
+		LocationPrevErrors[Idx] = LocErr;
+		const FVector PIDOut = (LocErr * LocationP[Idx]
+			+ LocationIntegrals[Idx] * LocationI[Idx]
+			+ LocDErr * LocationD[Idx]).BoundToCube(LocationMaxOutAbs[Idx]);
+		LocationOutputs[Idx] = (PIDOut + LocationFeedForwards[Idx]).BoundToCube(LocationMaxOutAbs[Idx]);
+
+		// Rotation
+		const FQuat TargetQuat = TargetQuats[Idx] * RotationAlignmentOffsets[Idx];
+		if (RotationPIDEnabled[Idx])
+		{
+			RotationOutputs[Idx] = MCRotationPIDUpdate(RotationIntegrals[Idx],
+				MCRotationErrorAxisAngle(TargetQuat, Quats[Idx]), AngularVelocities[Idx], DeltaTime,
+				RotationP[Idx], RotationI[Idx], RotationD[Idx], RotationMaxOutAbs[Idx]);
+		}
+		else
+		{
+			RotationOutputs[Idx] = MCRotationError(TargetQuat, Quats[Idx]) * RotationP[Idx];
+		}
+	}, Controllers.Num() < MinParallelBatchSize);
+}
+
+// Apply the control outputs to all the bodies (physics scene has to be locked)
+void AMCMovementControllerManager::WriteOutputs_AssumesLocked(bool bAllowSubstepping)
+{
+	for (int32 Idx = 0; Idx < Bodies.Num(); ++Idx)
+	{
+		FBodyInstance* Body = Bodies[Idx];
+		if (!Body)
+		{
+			continue;
+		}
+
+		switch (LocationControlTypes[Idx])
+		{
+		case EMCLocationControlType::Force:
+			FMCLocationControlForce::Apply_AssumesLocked(*Body, LocationOutputs[Idx], bAllowSubstepping);
+			break;
+		case EMCLocationControlType::Acceleration:
+			FMCLocationControlAcceleration::Apply_AssumesLocked(*Body, LocationOutputs[Idx], bAllowSubstepping);
+			break;
+		case EMCLocationControlType::Impulse:
+			FMCLocationControlImpulse::Apply_AssumesLocked(*Body, LocationOutputs[Idx], bAllowSubstepping);
+			break;
+		case EMCLocationControlType::Velocity:
+			FMCLocationControlVelocity::Apply_AssumesLocked(*Body, LocationOutputs[Idx], bAllowSubstepping);
+			break;
+		default:
+			break;
+		}
+
+		switch (RotationControlTypes[Idx])
+		{
+		case EMCRotationControlType::Torque:
+			FMCRotationControlTorque::Apply_AssumesLocked(*Body, RotationOutputs[Idx], bAllowSubstepping);
+			break;
+		case EMCRotationControlType::Acceleration:
+			FMCRotationControlAcceleration::Apply_AssumesLocked(*Body, RotationOutputs[Idx], bAllowSubstepping);
+			break;
+		case EMCRotationControlType::Impulse:
+			FMCRotationControlImpulse::Apply_AssumesLocked(*Body, RotationOutputs[Idx], bAllowSubstepping);
+			break;
+		case EMCRotationControlType::Velocity:
+			FMCRotationControlVelocity::Apply_AssumesLocked(*Body, RotationOutputs[Idx], bAllowSubstepping);
+			break;
+		default:
+			break;
+		}
+	}
+}
@@ -5,6 +5,9 @@
 #include "IHeadMountedDisplay.h"
 #include "IXRTrackingSystem.h"
 #include "XRMotionControllerBase.h"
+#include "UPhysicsBasedMC.h"
+
+DECLARE_FLOAT_ACCUMULATOR_STAT(TEXT("Hand Pose Bytes Per Second (Per Hand)"), STAT_MCHandPoseBytesPerSecondPerHand, STATGROUP_PhysicsBasedMC);
 
 // Sets default values
 AMCPawn::AMCPawn()
@@ -17,6 +20,11 @@ AMCPawn::AMCPawn()
 	// Display MC meshes by default
 	bVisualizeMCMeshes = true;
 
+	// Movement and camera updates per second kept with the adaptive hand replication
+	MinAdaptiveNetUpdateFrequency = 10.f;
+	DefaultNetUpdateFrequency = NetUpdateFrequency;
+	DefaultNetPriority = NetPriority;
+
 	// Crate MC root
 	MCRoot = CreateDefaultSubobject<USceneComponent>(TEXT("MCRoot"));
 	//MCRoot->SetupAttachment(GetRootComponent());
@@ -59,6 +67,10 @@ void AMCPawn::BeginPlay()
 {
 	Super::BeginPlay();
 
+	// Net update frequency and priority as set up, scaled by the hands with adaptive replication
+	DefaultNetUpdateFrequency = NetUpdateFrequency;
+	DefaultNetPriority = NetPriority;
+
 	// MC meshes visualization
 	MCLeft->bDisplayDeviceModel = bVisualizeMCMeshes;
 	MCRight->bDisplayDeviceModel = bVisualizeMCMeshes;
@@ -95,6 +107,31 @@ void AMCPawn::Tick(float DeltaTime)
 	UE_LOG(LogTemp, Warning, TEXT("[%s] Disable me"), *FString(__FUNCTION__));
 }
 
+// Update at the rate and priority of the fastest moving hand if every hand is adaptive
+void AMCPawn::PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker)
+{
+	Super::PreReplication(ChangedPropertyTracker);
+
+	// Average of the hands of this pawn (kept between the net updates), with several pawns the last replicated one is shown
+	SET_FLOAT_STAT(STAT_MCHandPoseBytesPerSecondPerHand,
+		0.5f * (MCHandLeft->GetPoseBytesPerSecond() + MCHandRight->GetPoseBytesPerSecond()));
+
+	// The net update frequency is actor wide, it is only lowered if every hand is adaptive,
+	// and kept above the floor of the rest of the replicated state (movement, camera)
+	const float LeftPoseUpdateRate = MCHandLeft->GetPoseUpdateRate();
+	const float RightPoseUpdateRate = MCHandRight->GetPoseUpdateRate();
+	if (LeftPoseUpdateRate > 0.f && RightPoseUpdateRate > 0.f)
+	{
+		NetUpdateFrequency = FMath::Max(FMath::Max(LeftPoseUpdateRate, RightPoseUpdateRate), MinAdaptiveNetUpdateFrequency);
+		NetPriority = DefaultNetPriority * FMath::Max(MCHandLeft->GetNetPriorityScale(), MCHandRight->GetNetPriorityScale());
+	}
+	else
+	{
+		NetUpdateFrequency = DefaultNetUpdateFrequency;
+		NetPriority = DefaultNetPriority;
+	}
+}
+
 // Called to bind functionality to input
 void AMCPawn::SetupPlayerInputComponent(UInputComponent* PlayerInputComponent)
 {
@@ -0,0 +1,143 @@
+// Copyright 2018, Institute for Artificial Intelligence - University of Bremen
+// Author: Andrei Haidu (http://haidu.eu)
+
+#include "MCPoseBenchCommandlet.h"
+#include "MCSkeletonIndexMap.h"
+#include "HAL/PlatformTime.h"
+#include "Components/PoseableMeshComponent.h"
+#include "Engine/SkeletalMesh.h"
+#include "Animation/Skeleton.h"
+
+// Constructor, set default values
+UMCPoseBenchCommandlet::UMCPoseBenchCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = true;
+	LogToConsole = true;
+
+	Iterations = 10000;
+}
+
+// Run the benchmark for every bone count
+int32 UMCPoseBenchCommandlet::Main(const FString& Params)
+{
+	const TCHAR* Parms = *Params;
+
+	FParse::Value(Parms, TEXT("Iterations="), Iterations);
+	Iterations = FMath::Max(Iterations, 1);
+
+	FString BonesList(TEXT("30,60"));
+	FParse::Value(Parms, TEXT("Bones="), BonesList, false);
+	TArray<FString> BoneCounts;
+	BonesList.ParseIntoArray(BoneCounts, TEXT(","));
+
+	for (const FString& BoneCount : BoneCounts)
+	{
+		const int32 NumBones = FCString::Atoi(*BoneCount);
+		if (NumBones < 2)
+		{
+			UE_LOG(LogTemp, Error, TEXT("[%s] Invalid bone count %s.."), TEXT(__FUNCTION__), *BoneCount);
+			return 1;
+		}
+		RunBenchmark(NumBones);
+	}
+	return 0;
+}
+
+// Benchmark the capture and the application of a hand pose with the given number of bones
+void UMCPoseBenchCommandlet::RunBenchmark(int32 NumBones) const
+{
+	// Transient hand mesh, five finger chains on the root bone with the bone names of a hand skeleton
+	USkeletalMesh* Mesh = NewObject<USkeletalMesh>(GetTransientPackage(), NAME_None, RF_Transient);
+	const int32 BonesPerFinger = FMath::Max((NumBones - 1) / 5, 1);
+	FRandomStream Random(NumBones);
+	{
+		FReferenceSkeletonModifier Modifier(Mesh->RefSkeleton, nullptr);
+		for (int32 BoneIdx = 0; BoneIdx < NumBones; ++BoneIdx)
+		{
+			const int32 FingerBoneIdx = (BoneIdx - 1) % BonesPerFinger;
+			const FName BoneName(*FString::Printf(TEXT("hand_bone_%02d_r"), BoneIdx));
+			const int32 ParentIdx = BoneIdx == 0 ? INDEX_NONE : (FingerBoneIdx == 0 ? 0 : BoneIdx - 1);
+			Modifier.Add(FMeshBoneInfo(BoneName, BoneName.ToString(), ParentIdx),
+				FTransform(FQuat(Random.GetUnitVector(), Random.FRandRange(-0.5f, 0.5f)), Random.GetUnitVector() * 3.f));
+		}
+	}
+	// The bone container of the poseable mesh requires a skeleton
+	USkeleton* Skeleton = NewObject<USkeleton>(GetTransientPackage(), NAME_None, RF_Transient);
+	Skeleton->MergeAllBonesToBoneTree(Mesh);
+	Mesh->Skeleton = Skeleton;
+
+	// Unregistered poseable mesh, only its bone transforms are used
+	UPoseableMeshComponent* PoseableMesh = NewObject<UPoseableMeshComponent>(GetTransientPackage(), NAME_None, RF_Transient);
+	PoseableMesh->SetSkeletalMesh(Mesh);
+	PoseableMesh->SetWorldTransform(FTransform(FQuat(FVector::UpVector, 0.3f), FVector(100.f, 50.f, 120.f)));
+	if (PoseableMesh->GetNumComponentSpaceTransforms() != NumBones || PoseableMesh->BoneSpaceTransforms.Num() != NumBones)
+	{
+		UE_LOG(LogTemp, Error, TEXT("[%s] Could not set up the transient %d bone mesh.."), TEXT(__FUNCTION__), NumBones);
+		return;
+	}
+
+	const FReferenceSkeleton& RefSkeleton = Mesh->RefSkeleton;
+	TArray<FName> BoneNames;
+	TArray<int32> ParentIndices;
+	for (int32 BoneIdx = 0; BoneIdx < NumBones; ++BoneIdx)
+	{
+		BoneNames.Add(RefSkeleton.GetBoneName(BoneIdx));
+		ParentIndices.Add(RefSkeleton.GetParentIndex(BoneIdx));
+	}
+
+	TArray<FTransform> World;
+	World.SetNum(NumBones);
+
+	// Capture, GetBoneQuaternion and GetBoneLocation by name for every bone
+	double StartTime = FPlatformTime::Seconds();
+	for (int32 Iter = 0; Iter < Iterations; ++Iter)
+	{
+		for (int32 BoneIdx = 0; BoneIdx < NumBones; ++BoneIdx)
+		{
+			World[BoneIdx] = FTransform(PoseableMesh->GetBoneQuaternion(BoneNames[BoneIdx]),
+				PoseableMesh->GetBoneLocation(BoneNames[BoneIdx]), FVector::OneVector);
+		}
+	}
+	const double NameCaptureTime = FPlatformTime::Seconds() - StartTime;
+
+	// Capture, one world transform multiply per bone in bone index order
+	StartTime = FPlatformTime::Seconds();
+	for (int32 Iter = 0; Iter < Iterations; ++Iter)
+	{
+		const TArray<FTransform>& ComponentSpaceTransforms = PoseableMesh->GetComponentSpaceTransforms();
+		const FTransform& ComponentTransform = PoseableMesh->GetComponentTransform();
+		for (int32 BoneIdx = 0; BoneIdx < NumBones; ++BoneIdx)
+		{
+			World[BoneIdx] = ComponentSpaceTransforms[BoneIdx] * ComponentTransform;
+			World[BoneIdx].SetScale3D(FVector::OneVector);
+		}
+	}
+	const double IndexCaptureTime = FPlatformTime::Seconds() - StartTime;
+
+	// Application, SetBoneTransformByName in world space for every bone
+	StartTime = FPlatformTime::Seconds();
+	for (int32 Iter = 0; Iter < Iterations; ++Iter)
+	{
+		for (int32 BoneIdx = 0; BoneIdx < NumBones; ++BoneIdx)
+		{
+			PoseableMesh->SetBoneTransformByName(BoneNames[BoneIdx], World[BoneIdx], EBoneSpaces::WorldSpace);
+		}
+	}
+	const double NameApplyTime = FPlatformTime::Seconds() - StartTime;
+
+	// Application, one bulk conversion into the bone space transforms and a single refresh request
+	StartTime = FPlatformTime::Seconds();
+	for (int32 Iter = 0; Iter < Iterations; ++Iter)
+	{
+		FMCSkeletonIndexMap::ToBoneSpace(ParentIndices, World, PoseableMesh->GetComponentTransform(), PoseableMesh->BoneSpaceTransforms);
+		PoseableMesh->MarkRefreshTransformDirty();
+	}
+	const double IndexApplyTime = FPlatformTime::Seconds() - StartTime;
+
+	const double ToMicroseconds = 1e6 / Iterations;
+	UE_LOG(LogTemp, Display, TEXT("[%s] %d bones: capture by name %.2f us, by index %.2f us; apply by name %.2f us, in bulk %.2f us"),
+		TEXT(__FUNCTION__), NumBones, NameCaptureTime * ToMicroseconds, IndexCaptureTime * ToMicroseconds,
+		NameApplyTime * ToMicroseconds, IndexApplyTime * ToMicroseconds);
+}
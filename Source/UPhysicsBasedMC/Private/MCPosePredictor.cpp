@@ -0,0 +1,102 @@
+// Copyright 2018, Institute for Artificial Intelligence - University of Bremen
+// Author: Andrei Haidu (http://haidu.eu)
+
+#include "MCPosePredictor.h"
+
+// Rotation vector (axis * angle) to quaternion
+static FORCEINLINE FQuat RotationVectorToQuat(const FVector& InRotVec)
+{
+	const float Angle = InRotVec.Size();
+	if (Angle < KINDA_SMALL_NUMBER)
+	{
+		return FQuat::Identity;
+	}
+	return FQuat(InRotVec / Angle, Angle);
+}
+
+// Quaternion to rotation vector (axis * angle), taking the shortest path
+static FORCEINLINE FVector QuatToRotationVector(FQuat InQuat)
+{
+	if (InQuat.W < 0.f)
+	{
+		InQuat *= -1.f;
+	}
+	FVector Axis;
+	float Angle;
+	InQuat.ToAxisAndAngle(Axis, Angle);
+	return Axis * Angle;
+}
+
+// Constructor, set default values
+FMCPosePredictor::FMCPosePredictor()
+{
+	PredictionHorizon = 0.03f;
+	Alpha = 0.5f;
+	Beta = 0.1f;
+	bEstimateAcceleration = false;
+	Gamma = 0.01f;
+	RotationAlpha = 0.5f;
+	RotationBeta = 0.1f;
+	Reset();
+}
+
+// Clear the filter state
+void FMCPosePredictor::Reset()
+{
+	Location = FVector::ZeroVector;
+	LinearVelocity = FVector::ZeroVector;
+	LinearAcceleration = FVector::ZeroVector;
+	Quat = FQuat::Identity;
+	AngularVelocity = FVector::ZeroVector;
+	bInitialized = false;
+}
+
+// Filter a new pose sample
+void FMCPosePredictor::Update(const FVector& InLocation, const FQuat& InQuat, float DeltaTime)
+{
+	if (!bInitialized || DeltaTime <= KINDA_SMALL_NUMBER)
+	{
+		if (!bInitialized)
+		{
+			Location = InLocation;
+			Quat = InQuat;
+			bInitialized = true;
+		}
+		return;
+	}
+
+	// Location, predict with the motion model and correct with the residual
+	const FVector PredLocation = Location + LinearVelocity * DeltaTime
+		+ LinearAcceleration * (0.5f * DeltaTime * DeltaTime);
+	const FVector PredVelocity = LinearVelocity + LinearAcceleration * DeltaTime;
+	const FVector LocResidual = InLocation - PredLocation;
+
+	Location = PredLocation + LocResidual * Alpha;
+	LinearVelocity = PredVelocity + LocResidual * (Beta / DeltaTime);
+	if (bEstimateAcceleration)
+	{
+		LinearAcceleration += LocResidual * (Gamma * 2.f / (DeltaTime * DeltaTime));
+	}
+
+	// Orientation, same on the rotation vector of the residual quaternion
+	const FQuat PredQuat = RotationVectorToQuat(AngularVelocity * DeltaTime) * Quat;
+	const FVector RotResidual = QuatToRotationVector(InQuat * PredQuat.Inverse());
+
+	Quat = RotationVectorToQuat(RotResidual * RotationAlpha) * PredQuat;
+	Quat.Normalize();
+	AngularVelocity += RotResidual * (RotationBeta / DeltaTime);
+}
+
+// Filtered pose extrapolated by the prediction horizon
+void FMCPosePredictor::GetPredictedPose(FVector& OutLocation, FQuat& OutQuat) const
+{
+	Extrapolate(PredictionHorizon, OutLocation, OutQuat);
+}
+
+// Filtered pose extrapolated by the given time
+void FMCPosePredictor::Extrapolate(float Time, FVector& OutLocation, FQuat& OutQuat) const
+{
+	OutLocation = Location + LinearVelocity * Time + LinearAcceleration * (0.5f * Time * Time);
+	OutQuat = RotationVectorToQuat(AngularVelocity * Time) * Quat;
+	OutQuat.Normalize();
+}
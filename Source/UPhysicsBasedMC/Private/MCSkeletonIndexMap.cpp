@@ -0,0 +1,129 @@
+// Copyright 2018, Institute for Artificial Intelligence - University of Bremen
+// Author: Andrei Haidu (http://haidu.eu)
+
+#include "MCSkeletonIndexMap.h"
+#include "Engine/SkeletalMesh.h"
+#include "PhysicsEngine/PhysicsAsset.h"
+#include "PhysicsEngine/PhysicsConstraintTemplate.h"
+#include "UObject/ObjectKey.h"
+#include "UObject/UObjectGlobals.h"
+
+namespace
+{
+	// Maps of the meshes and physics assets that are in use
+	typedef TPair<FObjectKey, FObjectKey> FMCIndexMapKey;
+	TMap<FMCIndexMapKey, TSharedPtr<const FMCSkeletonIndexMap>> IndexMapCache;
+
+	// Remove the maps of the changed asset, and the maps of the assets that have been garbage collected
+	void EvictIndexMaps(const UObject* InChangedAsset)
+	{
+		const FObjectKey ChangedKey(InChangedAsset);
+		for (auto Itr = IndexMapCache.CreateIterator(); Itr; ++Itr)
+		{
+			const FMCIndexMapKey& Key = Itr.Key();
+			if ((InChangedAsset && (Key.Key == ChangedKey || Key.Value == ChangedKey))
+				|| !Key.Key.ResolveObjectPtr() || (Key.Value != FObjectKey() && !Key.Value.ResolveObjectPtr()))
+			{
+				Itr.RemoveCurrent();
+			}
+		}
+	}
+
+#if WITH_EDITOR
+	// Reimported or edited meshes and physics assets are mapped again the next time they are used
+	void OnAssetPropertyChanged(UObject* InObject, FPropertyChangedEvent& PropertyChangedEvent)
+	{
+		if (InObject && (InObject->IsA<USkeletalMesh>() || InObject->IsA<UPhysicsAsset>()))
+		{
+			EvictIndexMaps(InObject);
+		}
+	}
+#endif // WITH_EDITOR
+}
+
+// Get the shared map of the mesh and physics asset of the component (game thread only)
+TSharedPtr<const FMCSkeletonIndexMap> FMCSkeletonIndexMap::Get(const USkeletalMeshComponent* InComponent)
+{
+	check(IsInGameThread());
+
+	USkeletalMesh* SkeletalMesh = InComponent ? InComponent->SkeletalMesh : nullptr;
+	if (!SkeletalMesh)
+	{
+		return nullptr;
+	}
+	UPhysicsAsset* PhysicsAsset = InComponent->GetPhysicsAsset();
+
+#if WITH_EDITOR
+	static const FDelegateHandle PropertyChangedHandle = FCoreUObjectDelegates::OnObjectPropertyChanged.AddStatic(&OnAssetPropertyChanged);
+#endif // WITH_EDITOR
+
+	const FMCIndexMapKey Key(FObjectKey(SkeletalMesh), FObjectKey(PhysicsAsset));
+	if (const TSharedPtr<const FMCSkeletonIndexMap>* Cached = IndexMapCache.Find(Key))
+	{
+		return *Cached;
+	}
+
+	// The maps of unloaded assets are dropped before a new one is added
+	EvictIndexMaps(nullptr);
+
+	TSharedPtr<FMCSkeletonIndexMap> IndexMap = MakeShareable(new FMCSkeletonIndexMap());
+
+	const FReferenceSkeleton& RefSkeleton = SkeletalMesh->RefSkeleton;
+	IndexMap->BoneNames.Reserve(RefSkeleton.GetNum());
+	IndexMap->ParentIndices.Reserve(RefSkeleton.GetNum());
+	for (int32 BoneIdx = 0; BoneIdx < RefSkeleton.GetNum(); ++BoneIdx)
+	{
+		const FName BoneName = RefSkeleton.GetBoneName(BoneIdx);
+		IndexMap->BoneNames.Add(BoneName);
+		IndexMap->ParentIndices.Add(RefSkeleton.GetParentIndex(BoneIdx));
+		IndexMap->BoneIndices.Add(BoneName, BoneIdx);
+	}
+
+	if (PhysicsAsset)
+	{
+		for (int32 ConstraintIdx = 0; ConstraintIdx < PhysicsAsset->ConstraintSetup.Num(); ++ConstraintIdx)
+		{
+			if (const UPhysicsConstraintTemplate* Template = PhysicsAsset->ConstraintSetup[ConstraintIdx])
+			{
+				IndexMap->ConstraintIndices.Add(Template->DefaultInstance.JointName, ConstraintIdx);
+			}
+		}
+	}
+
+	IndexMapCache.Add(Key, IndexMap);
+	return IndexMap;
+}
+
+// Constraint instance of the component with the given joint name, nullptr if not found
+FConstraintInstance* FMCSkeletonIndexMap::FindConstraint(const USkeletalMeshComponent* InComponent, FName InJointName) const
+{
+	// The component creates its constraints in the order of the physics asset
+	const int32 ConstraintIdx = GetConstraintIndex(InJointName);
+	if (InComponent->Constraints.IsValidIndex(ConstraintIdx))
+	{
+		FConstraintInstance* Constraint = InComponent->Constraints[ConstraintIdx];
+		if (Constraint && Constraint->JointName == InJointName)
+		{
+			return Constraint;
+		}
+	}
+
+	// Constraints have been skipped, fall back to the name comparison
+	FConstraintInstance* const* Constraint = InComponent->Constraints.FindByPredicate(
+		[InJointName](const FConstraintInstance* ConstrInst) { return ConstrInst && ConstrInst->JointName == InJointName; });
+	return Constraint ? *Constraint : nullptr;
+}
+
+// Convert the world or component space transforms of all the bones to bone space in one pass,
+// the root bones are made relative to the given root parent (e.g. the component transform for world space)
+void FMCSkeletonIndexMap::ToBoneSpace(const TArray<int32>& InParentIndices, const TArray<FTransform>& InTransforms,
+	const FTransform& InRootParent, TArray<FTransform>& OutBoneSpaceTransforms)
+{
+	const int32 Num = FMath::Min3(InParentIndices.Num(), InTransforms.Num(), OutBoneSpaceTransforms.Num());
+	for (int32 BoneIdx = 0; BoneIdx < Num; ++BoneIdx)
+	{
+		const int32 ParentIdx = InParentIndices[BoneIdx];
+		OutBoneSpaceTransforms[BoneIdx] = InTransforms[BoneIdx].GetRelativeTransform(
+			InTransforms.IsValidIndex(ParentIdx) ? InTransforms[ParentIdx] : InRootParent);
+	}
+}
@@ -0,0 +1,595 @@
+// Copyright 2018, Institute for Artificial Intelligence - University of Bremen
+// Author: Andrei Haidu (http://haidu.eu)
+
+#include "MCTuningCommandlet.h"
+#include "MCMovementControlGains.h"
+#include "MCControlPolicies.h"
+#include "Algo/BinarySearch.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/PackageName.h"
+#include "UObject/Package.h"
+
+// Constructor, set default values
+UMCTuningCommandlet::UMCTuningCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = true;
+	LogToConsole = true;
+
+	bStepTrajectory = false;
+	StepTime = 0.1f;
+	StepLocation = FVector(10.f, 0.f, 0.f);
+	StepRotationVector = FVector(0.f, 0.f, HALF_PI);
+	LocationScale = 1.f;
+	RotationScale = 1.f;
+	SettlingBand = 0.02f;
+
+	FrameRate = 90.f;
+	Substeps = 4;
+	bSubstepSync = false;
+	Mass = 1.f;
+	Inertia = 0.01f;
+
+	Iterations = 30;
+	OvershootWeight = 1.f;
+	SettlingTimeWeight = 0.5f;
+}
+
+// Run the benchmark or the tuning
+int32 UMCTuningCommandlet::Main(const FString& Params)
+{
+	const TCHAR* Parms = *Params;
+
+	// Simulation settings
+	FParse::Value(Parms, TEXT("FrameRate="), FrameRate);
+	FParse::Value(Parms, TEXT("Substeps="), Substeps);
+	FParse::Value(Parms, TEXT("Mass="), Mass);
+	FParse::Value(Parms, TEXT("Inertia="), Inertia);
+	FParse::Value(Parms, TEXT("Iterations="), Iterations);
+	bSubstepSync = FParse::Param(Parms, TEXT("SubstepSync"));
+	FrameRate = FMath::Max(FrameRate, 1.f);
+	Substeps = FMath::Max(Substeps, 1);
+	Mass = FMath::Max(Mass, KINDA_SMALL_NUMBER);
+	Inertia = FMath::Max(Inertia, KINDA_SMALL_NUMBER);
+
+	// Target trajectory
+	FString TrajectoryName(TEXT("Step"));
+	FParse::Value(Parms, TEXT("Trajectory="), TrajectoryName);
+	if (!LoadTrajectory(TrajectoryName))
+	{
+		UE_LOG(LogTemp, Error, TEXT("[%s] Could not load the trajectory %s.."), TEXT(__FUNCTION__), *TrajectoryName);
+		return 1;
+	}
+
+	// Start gains, from an existing asset or the defaults
+	UMCMovementControlGains* Gains = nullptr;
+	FString GainsPath;
+	if (FParse::Value(Parms, TEXT("Gains="), GainsPath))
+	{
+		if (UMCMovementControlGains* LoadedGains = LoadObject<UMCMovementControlGains>(nullptr, *GainsPath))
+		{
+			Gains = DuplicateObject(LoadedGains, GetTransientPackage());
+		}
+		else
+		{
+			UE_LOG(LogTemp, Error, TEXT("[%s] Could not load the gains %s.."), TEXT(__FUNCTION__), *GainsPath);
+			return 1;
+		}
+	}
+	else
+	{
+		Gains = NewObject<UMCMovementControlGains>(GetTransientPackage());
+	}
+
+	// Control types
+	FString TypeName;
+	if (FParse::Value(Parms, TEXT("LocType="), TypeName))
+	{
+		const UEnum* LocEnum = FindObject<UEnum>(ANY_PACKAGE, TEXT("EMCLocationControlType"), true);
+		const int64 Value = LocEnum ? LocEnum->GetValueByNameString(LocEnum->GenerateFullEnumName(*TypeName)) : INDEX_NONE;
+		if (Value == INDEX_NONE)
+		{
+			UE_LOG(LogTemp, Error, TEXT("[%s] Unknown location control type %s.."), TEXT(__FUNCTION__), *TypeName);
+			return 1;
+		}
+		Gains->LocationControlType = static_cast<EMCLocationControlType>(Value);
+	}
+	if (FParse::Value(Parms, TEXT("RotType="), TypeName))
+	{
+		const UEnum* RotEnum = FindObject<UEnum>(ANY_PACKAGE, TEXT("EMCRotationControlType"), true);
+		const int64 Value = RotEnum ? RotEnum->GetValueByNameString(RotEnum->GenerateFullEnumName(*TypeName)) : INDEX_NONE;
+		if (Value == INDEX_NONE)
+		{
+			UE_LOG(LogTemp, Error, TEXT("[%s] Unknown rotation control type %s.."), TEXT(__FUNCTION__), *TypeName);
+			return 1;
+		}
+		Gains->RotationControlType = static_cast<EMCRotationControlType>(Value);
+	}
+
+	if (FParse::Param(Parms, TEXT("Tune")))
+	{
+		FString OutputPath(TEXT("/Game/MC/TunedGains"));
+		FParse::Value(Parms, TEXT("Output="), OutputPath);
+		RunTuning(Gains, OutputPath);
+	}
+	else
+	{
+		RunBenchmark(Gains);
+	}
+	return 0;
+}
+
+// Benchmark every location x rotation control type with the given gains
+void UMCTuningCommandlet::RunBenchmark(const UMCMovementControlGains* InGains)
+{
+	static const EMCLocationControlType LocationTypes[] = {
+		EMCLocationControlType::Force,
+		EMCLocationControlType::Acceleration,
+		EMCLocationControlType::Impulse,
+		EMCLocationControlType::Velocity,
+		EMCLocationControlType::Position };
+
+	static const EMCRotationControlType RotationTypes[] = {
+		EMCRotationControlType::Torque,
+		EMCRotationControlType::Acceleration,
+		EMCRotationControlType::Impulse,
+		EMCRotationControlType::Velocity,
+		EMCRotationControlType::Position };
+
+	const UEnum* LocEnum = FindObject<UEnum>(ANY_PACKAGE, TEXT("EMCLocationControlType"), true);
+	const UEnum* RotEnum = FindObject<UEnum>(ANY_PACKAGE, TEXT("EMCRotationControlType"), true);
+
+	UE_LOG(LogTemp, Display, TEXT("[%s] %d Hz, %d substeps, substep sync=%d, mass=%.3f kg, inertia=%.4f kg m2"),
+		TEXT(__FUNCTION__), FMath::RoundToInt(FrameRate), Substeps, bSubstepSync, Mass, Inertia);
+	UE_LOG(LogTemp, Display, TEXT("%-14s %-14s %10s %10s %10s %10s %10s %10s %10s"),
+		TEXT("Location"), TEXT("Rotation"), TEXT("LocRMS cm"), TEXT("LocOver"), TEXT("LocSettle"),
+		TEXT("RotRMS deg"), TEXT("RotOver"), TEXT("RotSettle"), TEXT("us/update"));
+
+	UMCMovementControlGains* Gains = DuplicateObject(InGains, GetTransientPackage());
+	for (EMCLocationControlType LocationType : LocationTypes)
+	{
+		for (EMCRotationControlType RotationType : RotationTypes)
+		{
+			Gains->LocationControlType = LocationType;
+			Gains->RotationControlType = RotationType;
+			const FMCTrackingMetrics Metrics = Simulate(Gains);
+
+			const FString LocName = LocEnum ? LocEnum->GetNameStringByValue(static_cast<int64>(LocationType)) : FString();
+			const FString RotName = RotEnum ? RotEnum->GetNameStringByValue(static_cast<int64>(RotationType)) : FString();
+			if (!Metrics.bStable)
+			{
+				UE_LOG(LogTemp, Display, TEXT("%-14s %-14s unstable"), *LocName, *RotName);
+				continue;
+			}
+			UE_LOG(LogTemp, Display, TEXT("%-14s %-14s %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f"),
+				*LocName, *RotName,
+				Metrics.LocationRMSError, Metrics.LocationOvershoot, Metrics.LocationSettlingTime,
+				Metrics.RotationRMSError, Metrics.RotationOvershoot, Metrics.RotationSettlingTime,
+				Metrics.MicrosecondsPerUpdate);
+		}
+	}
+}
+
+// Tune the gains of the given control types and save them as a data asset
+void UMCTuningCommandlet::RunTuning(UMCMovementControlGains* InGains, const FString& OutputPath)
+{
+	// Location and rotation are independent in the simulation, tune them separately
+	// with a log scale coordinate descent on the gains, the step shrinks when no gain improves the cost
+	auto CoordinateDescent = [this, InGains](TArray<float*>& Gains, TFunctionRef<float(const FMCTrackingMetrics&)> Cost)
+	{
+		float BestCost = Cost(Simulate(InGains));
+		float StepFactor = 2.f;
+		for (int32 Iter = 0; Iter < Iterations && StepFactor > 1.01f; ++Iter)
+		{
+			bool bImproved = false;
+			for (float* Gain : Gains)
+			{
+				const float Start = *Gain;
+				for (const float Candidate : { Start * StepFactor, Start / StepFactor })
+				{
+					*Gain = Candidate;
+					const float CandidateCost = Cost(Simulate(InGains));
+					if (CandidateCost < BestCost)
+					{
+						BestCost = CandidateCost;
+						bImproved = true;
+						break;
+					}
+					*Gain = Start;
+				}
+			}
+			if (!bImproved)
+			{
+				StepFactor = FMath::Sqrt(StepFactor);
+			}
+		}
+		return BestCost;
+	};
+
+	float TotalCost = 0.f;
+
+	const bool bLocationFeedback = InGains->LocationControlType != EMCLocationControlType::NONE
+		&& InGains->LocationControlType != EMCLocationControlType::Position;
+	if (bLocationFeedback)
+	{
+		// The log scale search cannot leave zero, only tune the gains that are already in use
+		TArray<float*> LocationGains;
+		for (float* Gain : { &InGains->LocationPIDController.P, &InGains->LocationPIDController.I, &InGains->LocationPIDController.D })
+		{
+			if (*Gain > 0.f)
+			{
+				LocationGains.Add(Gain);
+			}
+		}
+		TotalCost += CoordinateDescent(LocationGains,
+			[this](const FMCTrackingMetrics& Metrics) { return GetLocationCost(Metrics); });
+	}
+
+	const bool bRotationFeedback = InGains->RotationControlType != EMCRotationControlType::NONE
+		&& InGains->RotationControlType != EMCRotationControlType::Position;
+	if (bRotationFeedback)
+	{
+		TArray<float*> RotationGains;
+		RotationGains.Add(&InGains->RotationPIDController.P);
+		if (InGains->bUseRotationPID)
+		{
+			for (float* Gain : { &InGains->RotationPIDController.I, &InGains->RotationPIDController.D })
+			{
+				if (*Gain > 0.f)
+				{
+					RotationGains.Add(Gain);
+				}
+			}
+		}
+		TotalCost += CoordinateDescent(RotationGains,
+			[this](const FMCTrackingMetrics& Metrics) { return GetRotationCost(Metrics); });
+	}
+
+	InGains->Substeps = Substeps;
+	InGains->TuningCost = TotalCost;
+
+	UE_LOG(LogTemp, Display, TEXT("[%s] Location P=%.3f I=%.3f D=%.3f; Rotation P=%.3f I=%.3f D=%.3f; Cost=%.4f"),
+		TEXT(__FUNCTION__),
+		InGains->LocationPIDController.P, InGains->LocationPIDController.I, InGains->LocationPIDController.D,
+		InGains->RotationPIDController.P, InGains->RotationPIDController.I, InGains->RotationPIDController.D,
+		TotalCost);
+
+#if WITH_EDITOR
+	UPackage* Package = CreatePackage(nullptr, *OutputPath);
+	UMCMovementControlGains* Asset = DuplicateObject(InGains, Package, *FPackageName::GetShortName(OutputPath));
+	Asset->SetFlags(RF_Public | RF_Standalone);
+	Package->MarkPackageDirty();
+	const FString Filename = FPackageName::LongPackageNameToFilename(OutputPath, FPackageName::GetAssetPackageExtension());
+	if (UPackage::SavePackage(Package, Asset, RF_Public | RF_Standalone, *Filename))
+	{
+		UE_LOG(LogTemp, Display, TEXT("[%s] Saved the gains to %s"), TEXT(__FUNCTION__), *Filename);
+	}
+	else
+	{
+		UE_LOG(LogTemp, Error, TEXT("[%s] Could not save the gains to %s.."), TEXT(__FUNCTION__), *Filename);
+	}
+#endif // WITH_EDITOR
+}
+
+// Load the target trajectory
+bool UMCTuningCommandlet::LoadTrajectory(const FString& TrajectoryName)
+{
+	TrajectoryTimes.Empty();
+	TrajectoryLocations.Empty();
+	TrajectoryQuats.Empty();
+	bStepTrajectory = false;
+	LocationScale = 1.f;
+	RotationScale = 1.f;
+
+	if (TrajectoryName.Equals(TEXT("Step"), ESearchCase::IgnoreCase))
+	{
+		// Hold still, then jump to the stepped pose and hold it
+		const float Duration = 2.f;
+		const FQuat StepQuat(StepRotationVector.GetSafeNormal(), StepRotationVector.Size());
+		TrajectoryTimes = { 0.f, StepTime, StepTime, Duration };
+		TrajectoryLocations = { FVector::ZeroVector, FVector::ZeroVector, StepLocation, StepLocation };
+		TrajectoryQuats = { FQuat::Identity, FQuat::Identity, StepQuat, StepQuat };
+		bStepTrajectory = true;
+		LocationScale = StepLocation.Size();
+		RotationScale = FMath::RadiansToDegrees(StepRotationVector.Size());
+		return true;
+	}
+
+	if (TrajectoryName.Equals(TEXT("Sine"), ESearchCase::IgnoreCase))
+	{
+		// Circle of 10cm at 0.5Hz with a +-45 deg yaw oscillation
+		const float Duration = 4.f;
+		const float SampleRate = 200.f;
+		const float Radius = 10.f;
+		const float Omega = 2.f * PI * 0.5f;
+		const int32 NumSamples = FMath::CeilToInt(Duration * SampleRate) + 1;
+		for (int32 Idx = 0; Idx < NumSamples; ++Idx)
+		{
+			const float Time = Idx / SampleRate;
+			TrajectoryTimes.Add(Time);
+			TrajectoryLocations.Add(FVector(Radius * FMath::Sin(Omega * Time), Radius * (1.f - FMath::Cos(Omega * Time)), 0.f));
+			TrajectoryQuats.Add(FQuat(FVector::UpVector, FMath::DegreesToRadians(45.f) * FMath::Sin(Omega * Time)));
+		}
+		LocationScale = Radius;
+		RotationScale = 45.f;
+		return true;
+	}
+
+	// Recorded session
+	TArray<FString> Lines;
+	if (!FFileHelper::LoadFileToStringArray(Lines, *TrajectoryName))
+	{
+		return false;
+	}
+	for (const FString& Line : Lines)
+	{
+		TArray<FString> Values;
+		Line.ParseIntoArray(Values, TEXT(","), true);
+		// Skip the header and malformed lines
+		if (Values.Num() < 8 || !Values[0].TrimStartAndEnd().IsNumeric())
+		{
+			continue;
+		}
+		const float Time = FCString::Atof(*Values[0]);
+		if (TrajectoryTimes.Num() > 0 && Time < TrajectoryTimes.Last())
+		{
+			continue;
+		}
+		TrajectoryTimes.Add(Time);
+		TrajectoryLocations.Add(FVector(FCString::Atof(*Values[1]), FCString::Atof(*Values[2]), FCString::Atof(*Values[3])));
+		TrajectoryQuats.Add(FQuat(FCString::Atof(*Values[4]), FCString::Atof(*Values[5]),
+			FCString::Atof(*Values[6]), FCString::Atof(*Values[7])).GetNormalized());
+	}
+	if (TrajectoryTimes.Num() < 2)
+	{
+		return false;
+	}
+
+	// Start the session at zero time
+	const float StartTime = TrajectoryTimes[0];
+	for (float& Time : TrajectoryTimes)
+	{
+		Time -= StartTime;
+	}
+	return true;
+}
+
+// Interpolated target pose at the given time
+void UMCTuningCommandlet::SampleTrajectory(float Time, FVector& OutLocation, FQuat& OutQuat) const
+{
+	const int32 Next = Algo::UpperBound(TrajectoryTimes, Time);
+	if (Next <= 0)
+	{
+		OutLocation = TrajectoryLocations[0];
+		OutQuat = TrajectoryQuats[0];
+		return;
+	}
+	if (Next >= TrajectoryTimes.Num())
+	{
+		OutLocation = TrajectoryLocations.Last();
+		OutQuat = TrajectoryQuats.Last();
+		return;
+	}
+
+	const int32 Prev = Next - 1;
+	const float Span = TrajectoryTimes[Next] - TrajectoryTimes[Prev];
+	const float Alpha = Span > KINDA_SMALL_NUMBER ? (Time - TrajectoryTimes[Prev]) / Span : 1.f;
+	OutLocation = FMath::Lerp(TrajectoryLocations[Prev], TrajectoryLocations[Next], Alpha);
+	OutQuat = FQuat::Slerp(TrajectoryQuats[Prev], TrajectoryQuats[Next], Alpha);
+}
+
+// Track the trajectory with the given control types and gains
+FMCTrackingMetrics UMCTuningCommandlet::Simulate(const UMCMovementControlGains* InGains) const
+{
+	FMCTrackingMetrics Metrics;
+
+	const float FrameDeltaTime = 1.f / FrameRate;
+	const float SubstepDeltaTime = FrameDeltaTime / Substeps;
+	const float Duration = TrajectoryTimes.Last();
+
+	const EMCLocationControlType LocationType = InGains->LocationControlType;
+	const EMCRotationControlType RotationType = InGains->RotationControlType;
+
+	// Copy of the controllers, the PID state is part of the struct
+	FPIDController3D LocationPID = InGains->LocationPIDController;
+	LocationPID.Init();
+	const FPIDController3D& RotationPID = InGains->RotationPIDController;
+	FVector RotationIntegral = FVector::ZeroVector;
+
+	// Rigid body state, starts on the target
+	FVector Location;
+	FQuat Quat;
+	SampleTrajectory(0.f, Location, Quat);
+	FVector LinearVelocity = FVector::ZeroVector;
+	FVector AngularVelocity = FVector::ZeroVector;
+
+	// Held control outputs (forces and accelerations)
+	FVector LinearAcceleration = FVector::ZeroVector;
+	FVector AngularAcceleration = FVector::ZeroVector;
+
+	// Step metrics
+	const FVector StepDirection = StepLocation.GetSafeNormal();
+	const float StepSize = StepLocation.Size();
+	const FVector StepAxis = StepRotationVector.GetSafeNormal();
+	const float StepAngle = StepRotationVector.Size();
+	float LocationUnsettledTime = 0.f;
+	float RotationUnsettledTime = 0.f;
+
+	double LocationSquaredErrorSum = 0.0;
+	double RotationSquaredErrorSum = 0.0;
+	uint64 ControlCycles = 0;
+	int32 NumUpdates = 0;
+	int32 NumFrames = 0;
+
+	// Compute the control outputs and apply them to the body state
+	auto ControlUpdate = [&](const FVector& TargetLocation, const FQuat& TargetQuat, float DeltaTime)
+	{
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+
+		LinearAcceleration = FVector::ZeroVector;
+		switch (LocationType)
+		{
+		case EMCLocationControlType::Force:
+			LinearAcceleration = LocationPID.Update(TargetLocation - Location, DeltaTime) / Mass;
+			break;
+		case EMCLocationControlType::Acceleration:
+			LinearAcceleration = LocationPID.Update(TargetLocation - Location, DeltaTime);
+			break;
+		case EMCLocationControlType::Impulse:
+			LinearVelocity += LocationPID.Update(TargetLocation - Location, DeltaTime);
+			break;
+		case EMCLocationControlType::Velocity:
+			LinearVelocity = LocationPID.Update(TargetLocation - Location, DeltaTime);
+			break;
+		case EMCLocationControlType::Position:
+			Location = TargetLocation;
+			LinearVelocity = FVector::ZeroVector;
+			break;
+		default:
+			break;
+		}
+
+		FVector RotationOutput = FVector::ZeroVector;
+		if (RotationType != EMCRotationControlType::NONE && RotationType != EMCRotationControlType::Position)
+		{
+			RotationOutput = InGains->bUseRotationPID
+				? MCRotationPIDUpdate(RotationIntegral, MCRotationErrorAxisAngle(TargetQuat, Quat), AngularVelocity,
+					DeltaTime, RotationPID.P, RotationPID.I, RotationPID.D, RotationPID.MaxOutAbs)
+				: MCRotationError(TargetQuat, Quat) * RotationPID.P;
+		}
+
+		AngularAcceleration = FVector::ZeroVector;
+		switch (RotationType)
+		{
+		case EMCRotationControlType::Torque:
+			AngularAcceleration = RotationOutput / Inertia;
+			break;
+		case EMCRotationControlType::Acceleration:
+			AngularAcceleration = RotationOutput;
+			break;
+		case EMCRotationControlType::Impulse:
+			AngularVelocity += RotationOutput;
+			break;
+		case EMCRotationControlType::Velocity:
+			AngularVelocity = RotationOutput;
+			break;
+		case EMCRotationControlType::Position:
+			Quat = TargetQuat;
+			AngularVelocity = FVector::ZeroVector;
+			break;
+		default:
+			break;
+		}
+
+		ControlCycles += FPlatformTime::Cycles64() - StartCycles;
+		NumUpdates++;
+	};
+
+	for (float Time = 0.f; Time <= Duration; Time += FrameDeltaTime)
+	{
+		// Target of the frame (no motion controller latency is simulated)
+		FVector TargetLocation;
+		FQuat TargetQuat;
+		SampleTrajectory(Time, TargetLocation, TargetQuat);
+
+		if (!bSubstepSync)
+		{
+			ControlUpdate(TargetLocation, TargetQuat, FrameDeltaTime);
+		}
+
+		for (int32 Substep = 0; Substep < Substeps; ++Substep)
+		{
+			if (bSubstepSync)
+			{
+				ControlUpdate(TargetLocation, TargetQuat, SubstepDeltaTime);
+			}
+
+			// Semi-implicit euler integration, forces are applied in every substep of the control update
+			LinearVelocity += LinearAcceleration * SubstepDeltaTime;
+			Location += LinearVelocity * SubstepDeltaTime;
+			AngularVelocity += AngularAcceleration * SubstepDeltaTime;
+			const float AngularSpeed = AngularVelocity.Size();
+			if (AngularSpeed > KINDA_SMALL_NUMBER)
+			{
+				Quat = FQuat(AngularVelocity / AngularSpeed, AngularSpeed * SubstepDeltaTime) * Quat;
+				Quat.Normalize();
+			}
+		}
+
+		// Tracking errors after the physics step
+		const FVector LocationError = TargetLocation - Location;
+		const FVector RotationError = MCRotationErrorAxisAngle(TargetQuat, Quat);
+		if (LocationError.ContainsNaN() || RotationError.ContainsNaN()
+			|| LocationError.Size() > 1e4f * LocationScale)
+		{
+			Metrics.bStable = false;
+			return Metrics;
+		}
+		LocationSquaredErrorSum += LocationError.SizeSquared();
+		RotationSquaredErrorSum += FMath::Square(FMath::RadiansToDegrees(RotationError.Size()));
+		NumFrames++;
+
+		if (bStepTrajectory && Time >= StepTime)
+		{
+			// Overshoot shows as an error opposing the step
+			if (StepSize > KINDA_SMALL_NUMBER)
+			{
+				Metrics.LocationOvershoot = FMath::Max(Metrics.LocationOvershoot, -(LocationError | StepDirection) / StepSize);
+				if (LocationError.Size() > SettlingBand * StepSize)
+				{
+					LocationUnsettledTime = Time;
+				}
+			}
+			if (StepAngle > KINDA_SMALL_NUMBER)
+			{
+				Metrics.RotationOvershoot = FMath::Max(Metrics.RotationOvershoot, -(RotationError | StepAxis) / StepAngle);
+				if (RotationError.Size() > SettlingBand * StepAngle)
+				{
+					RotationUnsettledTime = Time;
+				}
+			}
+		}
+	}
+
+	if (NumFrames > 0)
+	{
+		Metrics.LocationRMSError = FMath::Sqrt(LocationSquaredErrorSum / NumFrames);
+		Metrics.RotationRMSError = FMath::Sqrt(RotationSquaredErrorSum / NumFrames);
+	}
+	if (bStepTrajectory)
+	{
+		Metrics.LocationSettlingTime = FMath::Max(LocationUnsettledTime - StepTime, 0.f);
+		Metrics.RotationSettlingTime = FMath::Max(RotationUnsettledTime - StepTime, 0.f);
+	}
+	if (NumUpdates > 0)
+	{
+		Metrics.MicrosecondsPerUpdate = FPlatformTime::ToMilliseconds64(ControlCycles) * 1000.0 / NumUpdates;
+	}
+	return Metrics;
+}
+
+// Tuning cost of the location tracking
+float UMCTuningCommandlet::GetLocationCost(const FMCTrackingMetrics& InMetrics) const
+{
+	if (!InMetrics.bStable)
+	{
+		return BIG_NUMBER;
+	}
+	return InMetrics.LocationRMSError / FMath::Max(LocationScale, KINDA_SMALL_NUMBER)
+		+ OvershootWeight * InMetrics.LocationOvershoot
+		+ SettlingTimeWeight * InMetrics.LocationSettlingTime;
+}
+
+// Tuning cost of the rotation tracking
+float UMCTuningCommandlet::GetRotationCost(const FMCTrackingMetrics& InMetrics) const
+{
+	if (!InMetrics.bStable)
+	{
+		return BIG_NUMBER;
+	}
+	return InMetrics.RotationRMSError / FMath::Max(RotationScale, KINDA_SMALL_NUMBER)
+		+ OvershootWeight * InMetrics.RotationOvershoot
+		+ SettlingTimeWeight * InMetrics.RotationSettlingTime;
+}
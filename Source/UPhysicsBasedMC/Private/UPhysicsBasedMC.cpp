@@ -3,6 +3,8 @@
 
 #include "UPhysicsBasedMC.h"
 
+DEFINE_STAT(STAT_MCPhysicsSceneLocks);
+
 #define LOCTEXT_NAMESPACE "FUPhysicsBasedMCModule"
 
 void FUPhysicsBasedMCModule::StartupModule()
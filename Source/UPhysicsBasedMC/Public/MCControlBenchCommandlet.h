@@ -0,0 +1,32 @@
+// Copyright 2018, Institute for Artificial Intelligence - University of Bremen
+// Author: Andrei Haidu (http://haidu.eu)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "MCControlBenchCommandlet.generated.h"
+
+/**
+ * Headless micro-benchmark of a per frame movement control update,
+ * the member function pointer dispatch of one function per control type (poses read from the components,
+ * one scene lock per body access) is compared with the selected control kernel on a simulated body
+ *
+ * UE4Editor-Cmd <Project> -run=MCControlBench -nullrhi [-Iterations=100000]
+ */
+UCLASS()
+class UPHYSICSBASEDMC_API UMCControlBenchCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	// Constructor, set default values
+	UMCControlBenchCommandlet();
+
+	// Run the benchmark for every feedback control type combination
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	// Number of control updates of every measurement
+	int32 Iterations;
+};
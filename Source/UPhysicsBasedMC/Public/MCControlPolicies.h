@@ -0,0 +1,212 @@
+// Copyright 2018, Institute for Artificial Intelligence - University of Bremen
+// Author: Andrei Haidu (http://haidu.eu)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PhysicsEngine/BodyInstance.h"
+#include "PhysicsPublic.h"
+#include "Physics/PhysicsInterfaceCore.h"
+
+/**
+* Location and rotation control policies of the movement controller,
+* every location x rotation policy combination compiles to one control kernel
+*
+* bFeedback - the policy needs the current pose and applies a controller output to the body
+* bTeleport - the policy teleports the component to the target (game thread only)
+* FeedForward - location term added to the feedback output from the target velocity or acceleration
+*
+* Apply and FeedForward access the body directly, the physics scene has to be locked by the caller,
+* this way the reads and writes of a control update share a single scene lock
+*/
+
+/* Location control policies */
+struct FMCLocationControlNone
+{
+	static constexpr bool bFeedback = false;
+	static constexpr bool bTeleport = false;
+	static FORCEINLINE void Apply_AssumesLocked(FBodyInstance& Body, const FVector& Out, bool bAllowSubstepping) {}
+	static FORCEINLINE FVector FeedForward_AssumesLocked(FBodyInstance& Body, const FVector& Velocity, const FVector& Acceleration)
+	{
+		return FVector::ZeroVector;
+	}
+};
+
+struct FMCLocationControlForce
+{
+	static constexpr bool bFeedback = true;
+	static constexpr bool bTeleport = false;
+	static FORCEINLINE void Apply_AssumesLocked(FBodyInstance& Body, const FVector& Out, bool bAllowSubstepping)
+	{
+		Body.GetPhysicsScene()->AddForce_AssumesLocked(&Body, Out, bAllowSubstepping, false);
+	}
+	static FORCEINLINE FVector FeedForward_AssumesLocked(FBodyInstance& Body, const FVector& Velocity, const FVector& Acceleration)
+	{
+		return Acceleration * FPhysicsInterface::GetMass_AssumesLocked(Body.ActorHandle);
+	}
+};
+
+struct FMCLocationControlAcceleration
+{
+	static constexpr bool bFeedback = true;
+	static constexpr bool bTeleport = false;
+	static FORCEINLINE void Apply_AssumesLocked(FBodyInstance& Body, const FVector& Out, bool bAllowSubstepping)
+	{
+		// Acceleration based (mass will have no effect)
+		Body.GetPhysicsScene()->AddForce_AssumesLocked(&Body, Out, bAllowSubstepping, true);
+	}
+	static FORCEINLINE FVector FeedForward_AssumesLocked(FBodyInstance& Body, const FVector& Velocity, const FVector& Acceleration)
+	{
+		return Acceleration;
+	}
+};
+
+struct FMCLocationControlImpulse
+{
+	static constexpr bool bFeedback = true;
+	static constexpr bool bTeleport = false;
+	static FORCEINLINE void Apply_AssumesLocked(FBodyInstance& Body, const FVector& Out, bool bAllowSubstepping)
+	{
+		// Velocity change, mass will have no effect
+		FPhysicsInterface::SetLinearVelocity_AssumesLocked(Body.ActorHandle,
+			FPhysicsInterface::GetLinearVelocity_AssumesLocked(Body.ActorHandle) + Out);
+	}
+	static FORCEINLINE FVector FeedForward_AssumesLocked(FBodyInstance& Body, const FVector& Velocity, const FVector& Acceleration)
+	{
+		return FVector::ZeroVector;
+	}
+};
+
+struct FMCLocationControlVelocity
+{
+	static constexpr bool bFeedback = true;
+	static constexpr bool bTeleport = false;
+	static FORCEINLINE void Apply_AssumesLocked(FBodyInstance& Body, const FVector& Out, bool bAllowSubstepping)
+	{
+		FPhysicsInterface::SetLinearVelocity_AssumesLocked(Body.ActorHandle, Out);
+	}
+	static FORCEINLINE FVector FeedForward_AssumesLocked(FBodyInstance& Body, const FVector& Velocity, const FVector& Acceleration)
+	{
+		return Velocity;
+	}
+};
+
+struct FMCLocationControlPosition
+{
+	static constexpr bool bFeedback = false;
+	static constexpr bool bTeleport = true;
+	static FORCEINLINE void Apply_AssumesLocked(FBodyInstance& Body, const FVector& Out, bool bAllowSubstepping) {}
+	static FORCEINLINE FVector FeedForward_AssumesLocked(FBodyInstance& Body, const FVector& Velocity, const FVector& Acceleration)
+	{
+		return FVector::ZeroVector;
+	}
+};
+
+/* Rotation control policies */
+struct FMCRotationControlNone
+{
+	static constexpr bool bFeedback = false;
+	static constexpr bool bTeleport = false;
+	static FORCEINLINE void Apply_AssumesLocked(FBodyInstance& Body, const FVector& Out, bool bAllowSubstepping) {}
+};
+
+struct FMCRotationControlTorque
+{
+	static constexpr bool bFeedback = true;
+	static constexpr bool bTeleport = false;
+	static FORCEINLINE void Apply_AssumesLocked(FBodyInstance& Body, const FVector& Out, bool bAllowSubstepping)
+	{
+		Body.GetPhysicsScene()->AddTorque_AssumesLocked(&Body, Out, bAllowSubstepping, false);
+	}
+};
+
+struct FMCRotationControlAcceleration
+{
+	static constexpr bool bFeedback = true;
+	static constexpr bool bTeleport = false;
+	static FORCEINLINE void Apply_AssumesLocked(FBodyInstance& Body, const FVector& Out, bool bAllowSubstepping)
+	{
+		// Acceleration based (mass will have no effect)
+		Body.GetPhysicsScene()->AddTorque_AssumesLocked(&Body, Out, bAllowSubstepping, true);
+	}
+};
+
+struct FMCRotationControlImpulse
+{
+	static constexpr bool bFeedback = true;
+	static constexpr bool bTeleport = false;
+	static FORCEINLINE void Apply_AssumesLocked(FBodyInstance& Body, const FVector& Out, bool bAllowSubstepping)
+	{
+		// Angular velocity change (rad/s), inertia will have no effect
+		FPhysicsInterface::SetAngularVelocity_AssumesLocked(Body.ActorHandle,
+			FPhysicsInterface::GetAngularVelocity_AssumesLocked(Body.ActorHandle) + Out);
+	}
+};
+
+struct FMCRotationControlVelocity
+{
+	static constexpr bool bFeedback = true;
+	static constexpr bool bTeleport = false;
+	static FORCEINLINE void Apply_AssumesLocked(FBodyInstance& Body, const FVector& Out, bool bAllowSubstepping)
+	{
+		FPhysicsInterface::SetAngularVelocity_AssumesLocked(Body.ActorHandle, Out);
+	}
+};
+
+struct FMCRotationControlPosition
+{
+	static constexpr bool bFeedback = false;
+	static constexpr bool bTeleport = true;
+	static FORCEINLINE void Apply_AssumesLocked(FBodyInstance& Body, const FVector& Out, bool bAllowSubstepping) {}
+};
+
+/* Shared computations */
+// Rotation error as the XYZ of the shortest path quaternion from the current to the target rotation
+FORCEINLINE FVector MCRotationError(const FQuat& TargetQuat, FQuat CurrQuat)
+{
+	// Check if cos theta from the dot product is negative,
+	// avoids taking the long path around the sphere
+	if ((TargetQuat | CurrQuat) < 0.f)
+	{
+		CurrQuat *= -1.f;
+	}
+	const FQuat QuatOut = TargetQuat * CurrQuat.Inverse();
+	return FVector(QuatOut.X, QuatOut.Y, QuatOut.Z);
+}
+
+// Rotation error as the axis-angle vector (rad) of the shortest path rotation from the current to the target rotation
+FORCEINLINE FVector MCRotationErrorAxisAngle(const FQuat& TargetQuat, FQuat CurrQuat)
+{
+	if ((TargetQuat | CurrQuat) < 0.f)
+	{
+		CurrQuat *= -1.f;
+	}
+	FQuat QuatOut = TargetQuat * CurrQuat.Inverse();
+	QuatOut.Normalize();
+	FVector Axis;
+	float Angle;
+	QuatOut.ToAxisAndAngle(Axis, Angle);
+	return Axis * Angle;
+}
+
+// Rotation PID step on the axis-angle error, damped with the measured angular velocity of the body,
+// the integral is only accumulated on the axes that are not saturated (anti-windup)
+FORCEINLINE FVector MCRotationPIDUpdate(FVector& InOutIntegral, const FVector& InError, const FVector& InAngularVelocity,
+	float DeltaTime, float P, float I, float D, float MaxOutAbs)
+{
+	if (DeltaTime <= 0.f || InError.ContainsNaN())
+	{
+		return FVector::ZeroVector;
+	}
+
+	const FVector Integral = InOutIntegral + InError * DeltaTime;
+	const FVector Out = InError * P + Integral * I - InAngularVelocity * D;
+	for (int32 Axis = 0; Axis < 3; ++Axis)
+	{
+		if (FMath::Abs(Out[Axis]) < MaxOutAbs || FMath::Sign(Out[Axis]) != FMath::Sign(InError[Axis]))
+		{
+			InOutIntegral[Axis] = Integral[Axis];
+		}
+	}
+	return (InError * P + InOutIntegral * I - InAngularVelocity * D).BoundToCube(MaxOutAbs);
+}
@@ -0,0 +1,78 @@
+// Copyright 2018, Institute for Artificial Intelligence - University of Bremen
+// Author: Andrei Haidu (http://haidu.eu)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "PhysicsEngine/BodyInstance.h"
+
+enum class EMCLocationControlType : uint8;
+enum class EMCRotationControlType : uint8;
+
+/**
+* Control of every body of the hand physics asset, the bone targets follow
+* the root body target with the reference pose offsets of the bones,
+* the data of the bones is kept in structure-of-arrays buffers
+*/
+struct FMCDistributedControl
+{
+	// Collect the bodies of the hand and their reference pose offsets relative to the root body,
+	// the bodies of the excluded bones (e.g. fingers driven by the grasp controller) are not controlled
+	void Init(USkeletalMeshComponent* InHand, const TMap<FName, float>& InBoneGainMultipliers,
+		const TArray<int32>& InExcludedBoneIndices = TArray<int32>());
+
+	// Refresh the body pointers if the physics state of the hand has been recreated
+	void RefreshBodies(USkeletalMeshComponent* InHand);
+
+	// Read the poses of all the bodies (physics scene has to be locked)
+	void ReadBodyPoses_AssumesLocked(bool bReadAngularVelocities);
+
+	// Compute the outputs of all the bones from the target of the root body
+	void Evaluate(const FTransform& InRootTarget, float P, float I, float D, float MaxOutAbs,
+		bool bRotationPID, float RotP, float RotI, float RotD, float RotMaxOutAbs, float DeltaTime);
+
+	// Apply the outputs to all the bodies, forces and torques are mass weighted (physics scene has to be locked)
+	void WriteOutputs_AssumesLocked(EMCLocationControlType InLocationType, EMCRotationControlType InRotationType,
+		const FVector& InLocationFeedForward, bool bAllowSubstepping);
+
+	// Total mass of the controlled bodies
+	float GetTotalMass() const { return TotalMass; }
+
+	// Number of controlled bodies
+	int32 Num() const { return Bodies.Num(); }
+
+private:
+	// Controlled bodies, the root body is the first
+	TArray<FBodyInstance*> Bodies;
+
+	// Bone names of the bodies
+	TArray<FName> BoneNames;
+
+	// Reference pose of the bodies relative to the root body
+	TArray<FTransform> BodyToRootOffsets;
+
+	// Share of the bodies from the total mass
+	TArray<float> MassFractions;
+
+	// Gain multipliers of the bodies
+	TArray<float> GainMultipliers;
+
+	// Current poses and angular velocities of the bodies
+	TArray<FTransform> Transforms;
+	TArray<FVector> AngularVelocities;
+
+	// Location PID state
+	TArray<FVector> LocationPrevErrors;
+	TArray<FVector> LocationIntegrals;
+
+	// Rotation PID state
+	TArray<FVector> RotationIntegrals;
+
+	// Control outputs
+	TArray<FVector> LocationOutputs;
+	TArray<FVector> RotationOutputs;
+
+	// Total mass of the controlled bodies
+	float TotalMass = 0.f;
+};
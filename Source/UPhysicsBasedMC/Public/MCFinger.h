@@ -39,6 +39,10 @@ struct UPHYSICSBASEDMC_API FMCFingerBone
 	// Bone constraint
 	FConstraintInstance* ConstraintInstance;
 
+	// The bone body is in stable contact with another object
+	UPROPERTY(VisibleAnywhere, Category = "Grasp Control")
+	bool bInContact = false;
+
 	// Init finger
 	void Init(/*EFingerBone InType, */const FString& InName, FConstraintInstance* InConstraintInstance)
 	{
@@ -76,4 +80,10 @@ public:
 	UPROPERTY(EditAnywhere, Category = "Grasp Control")
 	FMCFingerBone Metacarpal;
 
+	// Any bone of the finger is in stable contact with another object
+	bool IsInContact() const
+	{
+		return Distal.bInContact || Intermediate.bInContact || Proximal.bInContact || Metacarpal.bInContact;
+	}
+
 };
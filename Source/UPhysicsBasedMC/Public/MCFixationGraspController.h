@@ -8,6 +8,10 @@
 #include "Components/SphereComponent.h"
 #include "Engine/StaticMeshActor.h"
 #include "MotionControllerComponent.h"
+#include "PhysicsEngine/ConstraintInstance.h"
+#include "WorldCollision.h"
+#include "MCGraspController.h"
+#include "MCGraspabilityRegistry.h"
 #include "MCFixationGraspController.generated.h"
 
 /**
@@ -31,6 +35,16 @@ public:
 	// Init fixation grasp	
 	void Init(USkeletalMeshComponent* InHand, UMotionControllerComponent* InMC, UInputComponent* InIC = nullptr);
 
+	// Weld the objects stably held by the fingers of the grasp controller
+	void SetupAutoFixation(UMCGraspController* InGraspController);
+
+	// Fixate stable grasps, detach them when the hand opens (game thread)
+	void UpdateAutoFixation();
+
+	// Automatically fixate the objects held by at least two opposing fingers
+	UPROPERTY(EditAnywhere, Category = "MC")
+	bool bAutoFixation;
+
 	// Object has been attached
 	bool HasAttached;
 
@@ -44,12 +58,33 @@ private:
 	// Try to fixate object to hand
 	void TryToFixate();
 
+	// Query the objects in reach, fixate the best ranked graspable one
+	void QueryAndFixate();
+
+	// Fixate the best ranked graspable object of the overlaps
+	void FixateBestCandidate(const TArray<FOverlapResult>& InOverlaps);
+
+	// Fixate the best ranked graspable object of the candidates
+	void FixateBestCandidate(const TArray<AStaticMeshActor*>& InCandidates);
+
+	// Async overlap query callback
+	void OnFixationOverlapQueryDone(const FTraceHandle& InTraceHandle, FOverlapDatum& InOverlapDatum);
+
 	// Fixate object to hand
 	void FixateObject(AStaticMeshActor* InSMA);
 
 	// Detach fixation
 	void TryToDetach();
 
+	// Setup the stiff constraints of the pool
+	void SetupConstraintPool();
+
+	// Connect the object to the hand with a pooled constraint, the object keeps simulating
+	bool ConstrainObject(AStaticMeshActor* InSMA);
+
+	// Break the constraint of the fixated object and return it to the pool
+	void ReleaseConstraint();
+
 	// Check if the static mesh actor can be grasped
 	bool CanBeGrasped(AStaticMeshActor* InActor);
 
@@ -63,6 +98,31 @@ private:
 	void OnFixationGraspAreaEndOverlap(class UPrimitiveComponent* HitComp, class AActor* OtherActor,
 		class UPrimitiveComponent* OtherComp, int32 OtherBodyIndex);
 
+	// Check the graspability of the objects with the cached entries of the world graspability registry (spawned if needed),
+	// otherwise an existing registry is only used if the indexed query or the approach query of a hand spawned it
+	UPROPERTY(EditAnywhere, Category = "MC")
+	bool bUseGraspabilityRegistry;
+
+	// Query the objects in reach when fixating instead of tracking them with overlap events
+	UPROPERTY(EditAnywhere, Category = "MC")
+	bool bOverlapQuery;
+
+	// Query the spatial index of the graspability registry instead of the physics scene
+	UPROPERTY(EditAnywhere, Category = "MC", meta = (editcondition = "bOverlapQuery"))
+	bool bIndexedQuery;
+
+	// Run the overlap query asynchronously, the object is fixated the next frame
+	UPROPERTY(EditAnywhere, Category = "MC", meta = (editcondition = "bOverlapQuery"))
+	bool bAsyncOverlapQuery;
+
+	// Grasp direction of the hand (component space), used to rank the queried objects
+	UPROPERTY(EditAnywhere, Category = "MC", meta = (editcondition = "bOverlapQuery"))
+	FVector GraspDirection;
+
+	// Weight of the alignment with the grasp direction against the distance when ranking the objects
+	UPROPERTY(EditAnywhere, Category = "MC", meta = (editcondition = "bOverlapQuery"))
+	float AlignmentWeight;
+
 	// Object maximum length (cm)
 	UPROPERTY(EditAnywhere, Category = "MC")
 	float ObjectMaxLength;
@@ -75,12 +135,67 @@ private:
 	UPROPERTY(EditAnywhere, Category = "MC")
 	bool bWeldFixation;
 
+	// Connect the object to the hand with a stiff constraint instead of attaching it
+	UPROPERTY(EditAnywhere, Category = "MC")
+	bool bConstraintFixation;
+
+	// Number of constraints of the hand pool
+	UPROPERTY(EditAnywhere, Category = "MC", meta = (editcondition = "bConstraintFixation", ClampMin = 1))
+	int32 ConstraintPoolSize;
+
+	// Constraints of the pool, initialized once and reused for every fixation
+	TArray<FConstraintInstance> ConstraintPool;
+
+	// Indices of the unused constraints of the pool
+	TArray<int32> FreeConstraints;
+
+	// Pool index of the constraint holding the fixated object, INDEX_NONE if attached
+	int32 FixationConstraintIdx;
+
+	// Frames the object has to be held with little relative motion before it is fixated
+	UPROPERTY(EditAnywhere, Category = "MC", meta = (editcondition = "bAutoFixation", ClampMin = 1))
+	int32 AutoFixationFrames;
+
+	// Maximum speed of the held object relative to the hand (cm/s)
+	UPROPERTY(EditAnywhere, Category = "MC", meta = (editcondition = "bAutoFixation"))
+	float AutoFixationMaxRelativeSpeed;
+
+	// Minimum grasp value of the hand for the automatic fixation, the hand has to be closing on the object
+	UPROPERTY(EditAnywhere, Category = "MC", meta = (editcondition = "bAutoFixation", ClampMin = 0.01, ClampMax = 1))
+	float AutoFixationMinGraspValue;
+
+	// Opening of the hand, as a fraction of the grasp value at fixation, after which the automatically fixated object is detached
+	UPROPERTY(EditAnywhere, Category = "MC", meta = (editcondition = "bAutoFixation", ClampMin = 0, ClampMax = 1))
+	float AutoDetachOpening;
+
+	// Grasp controller providing the finger contacts
+	UMCGraspController* GraspController;
+
+	// Candidate object of the automatic fixation and the number of frames it has been stably held
+	AActor* StableGraspCandidate;
+	int32 StableGraspFrames;
+
+	// Grasp value when the object has been automatically fixated
+	float AutoFixationGraspValue;
+
+	// The fixated object has been automatically fixated
+	bool bAutoFixated;
+
 	// Hand to fixate (attach) the object to
 	USkeletalMeshComponent* SkeletalHand;
 	
+	// Cached graspability of the actors of the world
+	AMCGraspabilityRegistry* GraspabilityRegistry;
+
 	// Array of items currently in reach (overlapping the sphere component)
 	TArray<AStaticMeshActor*> ObjectsInReach;
 
+	// Callback of the async overlap queries
+	FOverlapDelegate OverlapQueryDelegate;
+
+	// The fixation input is still pressed, the async query result can be used
+	bool bFixationRequested;
+
 #if WITH_SEMLOG
 	// Semantic grasp event trigger
 	class USLGraspTrigger* SLGraspTrigger;
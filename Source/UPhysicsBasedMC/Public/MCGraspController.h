@@ -8,7 +8,10 @@
 #include "Components/SphereComponent.h"
 #include "MotionControllerComponent.h"
 #include "MCFinger.h"
+#include "MCGraspPose.h"
+#include "MCSkeletonIndexMap.h"
 #include "PhysicsEngine/ConstraintDrives.h"
+#include "Templates/Atomic.h"
 #include "MCGraspController.generated.h"
 
 
@@ -18,7 +21,63 @@
 UENUM()
 enum class EGraspStyle : uint8
 {
-	PowerSphere			UMETA(DisplayName = "PowerSphere")
+	PowerSphere			UMETA(DisplayName = "PowerSphere"),
+	Pinch				UMETA(DisplayName = "Pinch"),
+	Tripod				UMETA(DisplayName = "Tripod"),
+	Lateral				UMETA(DisplayName = "Lateral"),
+	Hook				UMETA(DisplayName = "Hook")
+};
+
+/**
+* Packed finger joint values (0..1) of a glove or finger tracking device
+*/
+struct FMCJointInput
+{
+	// Number of finger joints of the grasp poses
+	static constexpr int32 MaxValues = 15;
+
+	// One value per finger (5) or per joint (15), in the grasp pose joint order
+	float Values[MaxValues];
+
+	// Number of valid values
+	int32 NumValues = 0;
+};
+
+/**
+* Latest joint input of a single producer thread for a single consumer thread,
+* a newer sample replaces an unread one (lock-free triple buffer)
+*/
+struct FMCJointInputSlot
+{
+	// Publish the sample (producer thread)
+	void Write(const FMCJointInput& InJointInput)
+	{
+		Buffers[WriteIdx] = InJointInput;
+		WriteIdx = State.Exchange(WriteIdx | FreshFlag) & IndexMask;
+	}
+
+	// Take the newest sample, false if there is no unread one (consumer thread)
+	bool Read(FMCJointInput& OutJointInput)
+	{
+		if (!(State.Load() & FreshFlag))
+		{
+			return false;
+		}
+		ReadIdx = State.Exchange(ReadIdx) & IndexMask;
+		OutJointInput = Buffers[ReadIdx];
+		return true;
+	}
+
+private:
+	// The shared state holds the index of the middle buffer and if it has not been read yet
+	static constexpr int32 IndexMask = 3;
+	static constexpr int32 FreshFlag = 4;
+
+	// Buffers owned by the producer, the consumer and the one in between
+	FMCJointInput Buffers[3];
+	int32 WriteIdx = 0;
+	int32 ReadIdx = 1;
+	TAtomic<int32> State{ 2 };
 };
 
 /**
@@ -36,23 +95,86 @@ public:
 	// Init grasp controller
 	void Init(USkeletalMeshComponent* InHand, EControllerHand InHandType, UInputComponent* InIC = nullptr);
 
+	// Switch the grasp style, the fingers move to the new pose with the current input
+	UFUNCTION(BlueprintCallable, Category = "Grasp Control")
+	void SetGraspStyle(EGraspStyle InGraspStyle);
+
+	// Publish the joint values of the device, lock-free for a single producer thread (e.g. the device thread),
+	// the newest values always win, false if the number of values is neither per finger nor per joint
+	bool PushJointInput(const float* InValues, int32 InNumValues);
+
+	// Apply the latest published joint input, only the changed joints are written (game thread)
+	void UpdateJointInput();
+
+	// Update the contact state of the finger joints, softens or restores the drives (game thread)
+	void UpdateFingerContacts();
+
+	// Finger (thumb 0, index 1, middle 2, ring 3, pinky 4) is in stable contact with another object
+	UFUNCTION(BlueprintCallable, Category = "Grasp Control")
+	bool IsFingerInContact(int32 FingerIndex) const;
+
+	// Actor in stable contact with at least two fingers with opposing contact normals, nullptr if none
+	AActor* GetOpposingContactActor() const;
+
+	// Keep the current contact states while the contacts are not reported (e.g. the object is welded)
+	void HoldFingerContacts(bool bHold) { bHoldContacts = bHold; }
+
+	// Current closing value of the hand (0..1), the average of the joint values with device input
+	float GetGraspValue() const;
+
+	// Bone indices of the finger joints in the grasp pose joint order, INDEX_NONE if not found (does not require Init)
+	void GetJointBoneIndices(const FMCSkeletonIndexMap& InIndexMap, TArray<int32>& OutBoneIndices) const;
+
 	// Grasp type
 	UPROPERTY(EditAnywhere, Category = "Grasp Control")
 	EGraspStyle GraspStyle;
 
+	// Drive the fingers from the per finger or per joint device input instead of the grasp axis
+	UPROPERTY(EditAnywhere, Category = "Grasp Control")
+	bool bUseJointInput;
+
+	// Stop closing the finger joints in stable contact and soften their drives
+	UPROPERTY(EditAnywhere, Category = "Grasp Control")
+	bool bContactAwareGrasp;
+
+	// Bone names of the finger joints (e.g. index_01), unmapped joints use the <joint>_l / <joint>_r bone names
+	UPROPERTY(EditAnywhere, Category = "Grasp Control")
+	TMap<FString, FName> BoneNameMapping;
+
+	// Joint target assets of the grasp styles, the power sphere style falls back to the uniform finger roll
+	UPROPERTY(EditAnywhere, Category = "Grasp Control")
+	TMap<EGraspStyle, UMCGraspPose*> GraspPoses;
+
 private:
 	// Bind grasping inputs
 	void SetupInputBindings(UInputComponent* InIC);
 
-	// Setup fingers // TODO able to modify bones from editor
+	// Setup fingers, the bone names can be mapped from the editor
 	void SetupFingers();
 
-	// Get finger constraint
-	FConstraintInstance* GetFingerConstraint(const FString& BoneName);
+	// Get finger constraint, nullptr if the hand has no constraint with the bone name
+	FConstraintInstance* GetFingerConstraint(FName BoneName) const;
 
 	// Update grasp
 	void Update(const float Val);
 
+	// Set the targets of the joints whose value changed, true if any changed
+	bool ApplyJointInput(const FMCJointInput& InJointInput);
+
+	// Write the changed drive targets of all the finger constraints under a single scene lock
+	void WriteDriveTargets();
+
+	// The joint is in contact and the new value would close it further, its target is held
+	bool IsJointHeld(int32 Idx, float Val) const
+	{
+		return JointsInContact[Idx] && Val >= LastJointValues[Idx];
+	}
+
+	// Contact callback of the hand bodies
+	UFUNCTION()
+	void OnFingerHit(UPrimitiveComponent* HitComp, AActor* OtherActor, UPrimitiveComponent* OtherComp,
+		FVector NormalImpulse, const FHitResult& Hit);
+
 	// Drive type
 	UPROPERTY(EditAnywhere, Category = "Grasp Control")
 	TEnumAsByte<EAngularDriveMode::Type> AngularDriveMode;
@@ -73,9 +195,80 @@ private:
 	UPROPERTY(EditAnywhere, Category = "Grasp Control", meta = (ClampMin = 0))
 	float UpdateMultiplier;
 
+	// Input changes below this value are ignored, resting fingers do not touch the physics scene
+	UPROPERTY(EditAnywhere, Category = "Grasp Control", meta = (ClampMin = 0))
+	float UpdateEpsilon;
+
+	// Input value of the last applied update, reset to force the next update
+	float LastUpdateValue;
+
+	// Latest grasp axis input, kept when the next update is forced
+	float LastInputValue;
+
+	// Consecutive frames of contact after which a joint counts as in stable contact
+	UPROPERTY(EditAnywhere, Category = "Grasp Control", meta = (editcondition = "bContactAwareGrasp", ClampMin = 1))
+	int32 ContactStableFrames;
+
+	// Drive spring and force limit scale of the joints in stable contact
+	UPROPERTY(EditAnywhere, Category = "Grasp Control", meta = (editcondition = "bContactAwareGrasp", ClampMin = 0, ClampMax = 1))
+	float ContactDriveScale;
+
+	// Joint targets of the current grasp style (nullptr for the uniform finger roll)
+	UMCGraspPose* ActiveGraspPose;
+
+	// Constraints of the finger bones (same index in every array)
+	TArray<FConstraintInstance*> FingerConstraints;
+
+	// Grasp pose joint indices of the finger constraints
+	TArray<int32> FingerJointIndices;
+
+	// Child bodies of the finger constraints
+	TArray<FBodyInstance*> FingerBodies;
+
+	// Drive targets to write
+	TArray<FQuat> DriveTargets;
+
+	// Drive targets written to the constraints
+	TArray<FQuat> AppliedDriveTargets;
+
+	// Input values of the last applied drive targets
+	TArray<float> LastJointValues;
+
+	// Finger bones of the finger constraints
+	TArray<FMCFingerBone*> FingerBoneRefs;
+
+	// Finger constraint indices of the bone names
+	TMap<FName, int32> FingerBodyIndices;
+
+	// Frame of the first and of the latest contact of the joint bodies
+	TArray<uint64> ContactStartFrames;
+	TArray<uint64> LastContactFrames;
+
+	// The joint bodies are in stable contact
+	TArray<bool> JointsInContact;
+
+	// The joint drives are softened
+	TArray<bool> SoftenedDrives;
+
+	// Actor and impact normal of the latest contact of the joint bodies (the held contacts can outlive their actors)
+	TArray<TWeakObjectPtr<AActor>> ContactActors;
+	TArray<FVector> ContactNormals;
+
+	// The contact states are kept as they are
+	bool bHoldContacts;
+
+	// Latest device input, single producer single consumer
+	TUniquePtr<FMCJointInputSlot> JointInputSlot;
+
+	// Latest applied device input
+	FMCJointInput LatestJointInput;
+
 	// Skeletal hand to control
 	USkeletalMeshComponent* SkeletalHand;
 
+	// Bone and constraint indices of the hand mesh
+	TSharedPtr<const FMCSkeletonIndexMap> SkeletonIndexMap;
+
 	// Handed
 	EControllerHand HandType;
 
@@ -0,0 +1,76 @@
+// Copyright 2018, Institute for Artificial Intelligence - University of Bremen
+// Author: Andrei Haidu (http://haidu.eu)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DataAsset.h"
+#include "Curves/CurveFloat.h"
+#include "MCGraspPose.generated.h"
+
+/**
+* Target rotation curves of a finger joint over the grasp value (0..1)
+*/
+USTRUCT()
+struct UPHYSICSBASEDMC_API FMCGraspJointCurves
+{
+	GENERATED_USTRUCT_BODY()
+
+	// Roll of the joint target (deg)
+	UPROPERTY(EditAnywhere, Category = "Grasp Pose")
+	FRuntimeFloatCurve Roll;
+
+	// Pitch of the joint target (deg)
+	UPROPERTY(EditAnywhere, Category = "Grasp Pose")
+	FRuntimeFloatCurve Pitch;
+
+	// Yaw of the joint target (deg)
+	UPROPERTY(EditAnywhere, Category = "Grasp Pose")
+	FRuntimeFloatCurve Yaw;
+
+	// Joint target at the given grasp value
+	FQuat Evaluate(float InValue) const;
+};
+
+/**
+ * Grasp style (pinch, tripod, lateral, hook etc.) as per joint target curves,
+ * baked into a quaternion lookup table shared by all the hands using the asset
+ */
+UCLASS(BlueprintType)
+class UPHYSICSBASEDMC_API UMCGraspPose : public UDataAsset
+{
+	GENERATED_BODY()
+
+public:
+	// Constructor, set default values
+	UMCGraspPose();
+
+	// Bake the table after loading
+	virtual void PostLoad() override;
+
+#if WITH_EDITOR
+	// Re-bake the table after editing the curves
+	virtual void PostEditChangeProperty(struct FPropertyChangedEvent& PropertyChangedEvent) override;
+#endif // WITH_EDITOR
+
+	// Finger joint names without the hand postfix, in the order of the table
+	static const TArray<FString>& GetJointNames();
+
+	// Bake the curves into the lookup table if it is out of date
+	void Bake();
+
+	// Joint target at the given grasp value (0..1), table lookup and slerp
+	FQuat GetJointTarget(int32 JointIndex, float InValue) const;
+
+	// Joint target curves, keyed with the joint names without the hand postfix (e.g. index_01)
+	UPROPERTY(EditAnywhere, Category = "Grasp Pose")
+	TMap<FString, FMCGraspJointCurves> JointCurves;
+
+	// Number of table samples over the grasp value
+	UPROPERTY(EditAnywhere, Category = "Grasp Pose", meta = (ClampMin = 2))
+	int32 TableResolution;
+
+private:
+	// Joint targets, the targets of all the joints of a sample are consecutive
+	TArray<FQuat> JointTargetTable;
+};
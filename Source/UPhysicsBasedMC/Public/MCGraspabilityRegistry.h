@@ -0,0 +1,204 @@
+// Copyright 2018, Institute for Artificial Intelligence - University of Bremen
+// Author: Andrei Haidu (http://haidu.eu)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Info.h"
+#include "Engine/StaticMeshActor.h"
+#include "UObject/ObjectKey.h"
+#include "MCGraspabilityRegistry.generated.h"
+
+/**
+* Graspability override of an actor
+*/
+UENUM()
+enum class EMCGraspableOverride : uint8
+{
+	None				UMETA(DisplayName = "None"),
+	Graspable			UMETA(DisplayName = "Graspable"),
+	NotGraspable		UMETA(DisplayName = "NotGraspable")
+};
+
+/**
+* Cached graspability metadata of an actor
+*/
+struct FMCGraspableEntry
+{
+	// Mass of the static mesh component (kg)
+	float Mass = 0.f;
+
+	// Bounding box diagonal of all the components (cm)
+	float Length = 0.f;
+
+	// Root component scale the entry was computed with
+	FVector Scale = FVector::OneVector;
+
+	// Root component is movable
+	uint8 bMovable : 1;
+
+	// Static mesh component simulates physics
+	uint8 bSimulating : 1;
+
+	// Entry has to be recomputed before it is used
+	uint8 bDirty : 1;
+
+	// Override from the actor tags or set explicitly
+	EMCGraspableOverride Override = EMCGraspableOverride::None;
+
+	FMCGraspableEntry() : bMovable(false), bSimulating(false), bDirty(true) {}
+};
+
+/**
+* Nearest graspable object of a location
+*/
+USTRUCT(BlueprintType)
+struct FMCApproachInfo
+{
+	GENERATED_USTRUCT_BODY()
+
+	// Nearest graspable object, nullptr if none is in range
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Grasp Control")
+	AStaticMeshActor* Object = nullptr;
+
+	// Distance to the object (cm)
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Grasp Control")
+	float Distance = 0.f;
+
+	// Approach direction towards the object (unit vector)
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Grasp Control")
+	FVector Direction = FVector::ZeroVector;
+};
+
+/**
+ * Graspability metadata of the static mesh actors of the world, built in parallel when the game starts,
+ * entries are recomputed when invalidated or when the actor scale or simulation state changes,
+ * the movable actors are kept in a spatial hash updated only for the actors that moved cells
+ */
+UCLASS(NotPlaceable, Transient)
+class UPHYSICSBASEDMC_API AMCGraspabilityRegistry : public AInfo
+{
+	GENERATED_BODY()
+
+public:
+	// Sets default values
+	AMCGraspabilityRegistry();
+
+	// Get the registry of the world, spawn one if none is available
+	static AMCGraspabilityRegistry* GetInstance(UWorld* InWorld);
+
+	// Get the registry of the world, nullptr if none is available (does not spawn one)
+	static AMCGraspabilityRegistry* FindInstance(UWorld* InWorld);
+
+	// Called when the game starts or when spawned
+	virtual void BeginPlay() override;
+
+	// Called every frame, after physics
+	virtual void Tick(float DeltaTime) override;
+
+	// Check if the actor can be grasped with the given limits, one table lookup if the entry is up to date
+	bool CanBeGrasped(AStaticMeshActor* InSMA, float InMaxMass, float InMaxLength);
+
+	// Entry of the actor, added or recomputed if needed
+	const FMCGraspableEntry& FindOrUpdate(AStaticMeshActor* InSMA);
+
+	// Recompute the entry of the actor on its next use, has to be called when its mass or bounds change
+	// (scale and simulation state changes are detected)
+	void Invalidate(AActor* InActor);
+
+	// Override the graspability of the actor
+	void SetOverride(AActor* InActor, EMCGraspableOverride InOverride);
+
+	// Override the graspability of the actors with the given tag (e.g. a semantic class tag)
+	void SetTagOverride(FName InTag, EMCGraspableOverride InOverride);
+
+	// Nearest graspable actor within the distance, false if none
+	bool FindNearest(const FVector& InLocation, float InMaxDistance, FMCApproachInfo& OutInfo);
+
+	// Graspable actors within the radius
+	void FindInRadius(const FVector& InLocation, float InRadius, TArray<AStaticMeshActor*>& OutActors);
+
+	// Number of entries
+	int32 Num() const { return Entries.Num(); }
+
+	// Spatial hash cell size (cm), about the size of the largest graspable objects
+	UPROPERTY(EditAnywhere, Category = "Grasp Control", meta = (ClampMin = 1))
+	float CellSize;
+
+	// Build the entries of the actors in parallel above this number of actors
+	UPROPERTY(EditAnywhere, Category = "Grasp Control", meta = (ClampMin = 1))
+	int32 MinParallelBuildSize;
+
+private:
+	// Build the entries of all the static mesh actors of the world
+	void Build();
+
+	// Recompute the entry if needed
+	const FMCGraspableEntry& UpdateEntry(int32 InIdx);
+
+	// Add the actor to its spatial hash cell
+	void AddToCell(int32 InIdx);
+
+	// Remove the actor from its spatial hash cell
+	void RemoveFromCell(int32 InIdx);
+
+	// Remove the entry, the last entry takes its index
+	void RemoveEntry(int32 InIdx);
+
+	// Remove the entries of the actors found destroyed while iterating
+	void RemoveStaleEntries();
+
+	// Remove the entry of the destroyed actor
+	UFUNCTION()
+	void OnEntryActorDestroyed(AActor* InActor);
+
+	// Spatial hash cell of the location
+	FIntVector GetCell(const FVector& InLocation) const
+	{
+		return FIntVector(
+			FMath::FloorToInt(InLocation.X / CellSize),
+			FMath::FloorToInt(InLocation.Y / CellSize),
+			FMath::FloorToInt(InLocation.Z / CellSize));
+	}
+
+	// Call the function with the entry index of every hashed actor in the cells overlapping the sphere
+	template<typename FunctionType>
+	void ForEachInRadius(const FVector& InLocation, float InRadius, FunctionType Function);
+
+	// Compute the entry of the actor, does not modify the registry (thread safe)
+	FMCGraspableEntry ComputeEntry(const AStaticMeshActor* InSMA) const;
+
+	// Override of the actor from its tags
+	EMCGraspableOverride GetTagOverride(const AActor* InActor) const;
+
+	// Overrides of the actors with the given tags
+	TMap<FName, EMCGraspableOverride> TagOverrides;
+
+	// Overrides set explicitly, kept when the entries are recomputed
+	TMap<FObjectKey, EMCGraspableOverride> ActorOverrides;
+
+	// Entry indices of the actors
+	TMap<FObjectKey, int32> EntryIndices;
+
+	/* Per entry data (same index in every array) */
+	// Compact table of the entries
+	TArray<FMCGraspableEntry> Entries;
+
+	// Actors of the entries, the entries of the destroyed actors are removed
+	TArray<TWeakObjectPtr<AStaticMeshActor>> EntryActors;
+
+	// Keys of the actors of the entries, valid after the actors are gone
+	TArray<FObjectKey> EntryKeys;
+
+	// Spatial hash cells of the movable actors
+	TArray<FIntVector> EntryCells;
+
+	// Entry indices of the movable actors
+	TArray<int32> MovableEntries;
+
+	// Entry indices of the actors in the spatial hash cells
+	TMap<FIntVector, TArray<int32>> Cells;
+
+	// Entries of the destroyed actors found while iterating
+	TArray<int32> StaleEntries;
+};
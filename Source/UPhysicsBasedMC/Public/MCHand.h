@@ -8,6 +8,10 @@
 #include "MCMovementController6D.h"
 #include "MCGraspController.h"
 #include "MCFixationGraspController.h"
+#include "MCSkeletonIndexMap.h"
+#include "MCGraspabilityRegistry.h"
+#include "MCHandPose.h"
+#include "MCPoseSnapshotBuffer.h"
 #include <Net/UnrealNetwork.h>
 #include "Runtime/Engine/Classes/Components/PoseableMeshComponent.h"
 #include "Runtime/Engine/Classes/Engine/SkeletalMeshSocket.h"
@@ -34,14 +38,53 @@ public:
 	// Init hand with the motion controllers
 	void Init(UMotionControllerComponent* InMC);
 
+	// Encode the quantized pose right before it is replicated
+	virtual void PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker) override;
+
+	// Grasp controller, device input is pushed to it
+	UMCGraspController* GetGraspController() const { return GraspController; }
+
+	// Pose updates per second wanted by the adaptive replication, zero if disabled (server)
+	float GetPoseUpdateRate() const { return bAdaptiveReplication ? PoseUpdateRate : 0.f; }
+
+	// Net priority scale wanted by the adaptive replication (server)
+	float GetNetPriorityScale() const { return NetPriorityScale; }
+
+	// Replicated pose payload of this hand, averaged over the last second (server)
+	float GetPoseBytesPerSecond() const { return PoseBytesPerSecond; }
+
+	// Replicated pose payload of the hand, averaged over the last second (server)
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "MC")
+	float PoseBytesPerSecond;
+
+	// Nearest graspable object, updated every frame from the spatial index (e.g. for grasp pre-shaping)
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "MC")
+	FMCApproachInfo ApproachInfo;
+
 	// List of all bone names
 	UPROPERTY(Replicated)
 		TArray<FName> ReplicatedBoneNames;
 
-	// List of all bone transforms
+	// Server time of the bone transforms (s)
 	UPROPERTY(Replicated)
+		float ReplicatedBoneTransformsTime;
+
+	// List of all bone transforms
+	UPROPERTY(ReplicatedUsing = OnRep_ReplicatedBoneTransforms)
 		TArray<FTransform> ReplicatedBoneTransforms;
 
+	// Quantized pose with all the bones, the baseline of the replicated pose (sent to new connections before it)
+	UPROPERTY(ReplicatedUsing = OnRep_ReplicatedKeyframe)
+		FMCQuantizedHandPose ReplicatedKeyframe;
+
+	// Quantized pose with the bones changed since the keyframe, replaces the bone name and transform arrays
+	UPROPERTY(ReplicatedUsing = OnRep_ReplicatedPose)
+		FMCQuantizedHandPose ReplicatedPose;
+
+	// Root pose and finger joint rotations, replaces the bone name and transform arrays
+	UPROPERTY(ReplicatedUsing = OnRep_ReplicatedJointPose)
+		FMCJointAnglesHandPose ReplicatedJointPose;
+
 	// A poseable mesh that will mirror the hands movements on the client side
 	UPROPERTY(EditAnywhere, Category = "MC")
 		UPoseableMeshComponent* PoseableMesh;
@@ -73,6 +116,43 @@ private:
 	virtual void PostEditChangeProperty(struct FPropertyChangedEvent& PropertyChangedEvent);
 #endif //WITH_EDITOR
 
+	// Buffer the received bone transforms
+	UFUNCTION()
+	void OnRep_ReplicatedBoneTransforms();
+
+	// Keep the bones of the received keyframe, reapply the pose if it was decoded without its keyframe
+	UFUNCTION()
+	void OnRep_ReplicatedKeyframe();
+
+	// Apply the received bones of the quantized pose on top of its keyframe to the poseable mesh
+	UFUNCTION()
+	void OnRep_ReplicatedPose();
+
+	// Rebuild the poseable mesh from the received root pose and joint rotations
+	UFUNCTION()
+	void OnRep_ReplicatedJointPose();
+
+	// Encode the root pose and the local finger joint rotations if any of them changed above the thresholds
+	void EncodeJointPose();
+
+	// Local rotations of the finger joints from the component space transforms, no bone name lookups
+	void GetJointRotations(TArray<FQuat>& OutJointRotations) const;
+
+	// Estimate the hand motion from the root velocity and the joint angle deltas, and the pose update rate from it
+	void UpdateReplicationRate(float DeltaTime);
+
+	// Count the replicated pose payload, the bytes per second are updated once per second
+	void AddPoseBytes(int32 InNumBytes);
+
+	// Add the received pose and the current attached mesh state to the snapshot buffer
+	void AddPoseSnapshot(double InServerTime, const FTransform& InRoot, const TArray<FTransform>& InBones);
+
+	// Apply the root and the bone transforms of the pose replication mode to the poseable mesh
+	void ApplyPose(const FTransform& InRoot, const TArray<FTransform>& InBones);
+
+	// Server time as known by the client (s)
+	double GetServerTime() const;
+
 	// Movement controller
 	UPROPERTY(EditAnywhere, Category = "MC")
 	UMCMovementController6D* MovementController;
@@ -88,4 +168,132 @@ private:
 	// Fixation grasp controller
 	UPROPERTY(EditAnywhere, Category = "MC", meta = (editcondition = "bEnableFixationGrasp"))
 	UMCFixationGraspController* FixationGraspController;
+
+	// Range of the nearest graspable object query, disabled if zero (cm)
+	UPROPERTY(EditAnywhere, Category = "MC", meta = (ClampMin = 0))
+	float ApproachQueryDistance;
+
+	// Spatial index of the graspable objects
+	AMCGraspabilityRegistry* GraspabilityRegistry;
+
+	// Replicated representation of the hand pose
+	UPROPERTY(EditAnywhere, Category = "MC")
+	EMCPoseReplication PoseReplication;
+
+	// Bone location change below which the bone is not sent (cm)
+	UPROPERTY(EditAnywhere, Category = "MC", meta = (ClampMin = 0))
+	float PoseLocationThreshold;
+
+	// Bone rotation change below which the bone is not sent (deg)
+	UPROPERTY(EditAnywhere, Category = "MC", meta = (ClampMin = 0))
+	float PoseRotationThreshold;
+
+	// Number of pose updates after which a new keyframe is sent, the updates in between grow with the bones changed since it
+	UPROPERTY(EditAnywhere, Category = "MC", meta = (ClampMin = 1))
+	int32 PoseKeyframeInterval;
+
+	// Component space bone transforms of the last keyframe, as sent (server) or received (client)
+	TArray<FTransform> KeyframeBoneTransforms;
+
+	// The received pose has been decoded on top of its keyframe (client)
+	bool bPoseOnKeyframe;
+
+	// Pose updates since the last keyframe (server)
+	int32 PoseUpdatesSinceKeyframe;
+
+	// Component space bone transforms as received, starting from the reference pose (client)
+	TArray<FTransform> ReceivedBoneTransforms;
+
+	// Play back the received poses with a delay, interpolated from a snapshot buffer
+	UPROPERTY(EditAnywhere, Category = "MC")
+	bool bInterpolatePoses;
+
+	// Playback delay behind the server time, about two to three update intervals (s)
+	UPROPERTY(EditAnywhere, Category = "MC", meta = (editcondition = "bInterpolatePoses", ClampMin = 0))
+	float PoseInterpolationDelay;
+
+	// Maximum extrapolation past the newest snapshot when updates are missing (s)
+	UPROPERTY(EditAnywhere, Category = "MC", meta = (editcondition = "bInterpolatePoses", ClampMin = 0))
+	float MaxPoseExtrapolation;
+
+	// Number of buffered snapshots
+	UPROPERTY(EditAnywhere, Category = "MC", meta = (editcondition = "bInterpolatePoses", ClampMin = 2))
+	int32 PoseBufferSize;
+
+	// Scale the pose update rate and the net priority with the hand motion, idle hands are throttled,
+	// the rate is applied to the net update frequency of the whole owning pawn (only if both hands are adaptive)
+	UPROPERTY(EditAnywhere, Category = "MC")
+	bool bAdaptiveReplication;
+
+	// Pose updates per second of an idle hand
+	UPROPERTY(EditAnywhere, Category = "MC", meta = (editcondition = "bAdaptiveReplication", ClampMin = 0.1))
+	float IdlePoseUpdateRate;
+
+	// Pose updates per second of a fast moving hand, and after grasp and release events
+	UPROPERTY(EditAnywhere, Category = "MC", meta = (editcondition = "bAdaptiveReplication", ClampMin = 0.1))
+	float MaxPoseUpdateRate;
+
+	// Hand motion below which the hand is idle (cm/s)
+	UPROPERTY(EditAnywhere, Category = "MC", meta = (editcondition = "bAdaptiveReplication", ClampMin = 0))
+	float IdleMotion;
+
+	// Hand motion from which the pose is sent at the maximum rate (cm/s)
+	UPROPERTY(EditAnywhere, Category = "MC", meta = (editcondition = "bAdaptiveReplication", ClampMin = 0))
+	float FullRateMotion;
+
+	// Hand motion per rotation speed of the root and the finger joints (cm/deg)
+	UPROPERTY(EditAnywhere, Category = "MC", meta = (editcondition = "bAdaptiveReplication", ClampMin = 0))
+	float AngularMotionScale;
+
+	// Net priority scale of an idle hand, fast moving hands have a scale of one
+	UPROPERTY(EditAnywhere, Category = "MC", meta = (editcondition = "bAdaptiveReplication", ClampMin = 0))
+	float IdleNetPriorityScale;
+
+	// Duration of the full rate updates after a grasp or a release (s)
+	UPROPERTY(EditAnywhere, Category = "MC", meta = (editcondition = "bAdaptiveReplication", ClampMin = 0))
+	float GraspBurstDuration;
+
+	// Print the replicated pose payload of this hand on screen (server)
+	UPROPERTY(EditAnywhere, Category = "MC")
+	bool bShowPoseBandwidth;
+
+	// Smoothed hand motion (cm/s, server)
+	float Motion;
+
+	// Current pose update rate and net priority scale (server)
+	float PoseUpdateRate;
+	float NetPriorityScale;
+
+	// Remaining time of the full rate updates (s, server)
+	float BurstTimeLeft;
+
+	// Grasp state of the previous frame, changes start the full rate updates (server)
+	bool bWasGrasping;
+
+	// Root pose and local joint rotations of the previous frame (server)
+	FTransform PrevRoot;
+	TArray<FQuat> PrevJointRotations;
+
+	// Time of the last sent pose (server)
+	float LastPoseUpdateTime;
+
+	// Pose bytes sent since the start of the bytes per second window (server)
+	int32 PoseBytesInWindow;
+	float PoseBytesWindowStart;
+
+	// Received poses (client)
+	FMCPoseSnapshotBuffer PoseSnapshots;
+
+	// Interpolated pose, reused every frame (client)
+	FMCPoseSnapshot InterpolatedPose;
+
+	// Bone indices of the finger joints, in the grasp pose joint order
+	TArray<int32> JointBoneIndices;
+
+	// Root pose and local joint rotations as last sent (server)
+	FTransform SentRoot;
+	TArray<FQuat> SentJointRotations;
+
+	// Bone and constraint indices of the hand mesh
+	TSharedPtr<const FMCSkeletonIndexMap> BoneIndexMap;
 };
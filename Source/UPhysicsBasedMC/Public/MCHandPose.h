@@ -0,0 +1,145 @@
+// Copyright 2018, Institute for Artificial Intelligence - University of Bremen
+// Author: Andrei Haidu (http://haidu.eu)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/NetSerialization.h"
+#include "MCHandPose.generated.h"
+
+/**
+* Hand pose replication mode
+*/
+UENUM()
+enum class EMCPoseReplication : uint8
+{
+	BoneTransforms		UMETA(DisplayName = "BoneTransforms"),
+	QuantizedBones		UMETA(DisplayName = "QuantizedBones"),
+	JointAngles			UMETA(DisplayName = "JointAngles")
+};
+
+/**
+* Quantized bone of the hand pose
+*/
+struct FMCQuantizedBone
+{
+	// Bone index of the hand mesh
+	uint16 Index;
+
+	// Smallest three packed component space rotation
+	uint32 Rotation;
+
+	// Fixed-point component space location (1/100 cm)
+	int16 Location[3];
+};
+
+/**
+ * Replicated hand pose, the root transform and all the bones (keyframe) or the bones changed since the keyframe,
+ * bones are encoded by index with smallest three rotations and fixed-point locations relative to the root
+ */
+USTRUCT()
+struct UPHYSICSBASEDMC_API FMCQuantizedHandPose
+{
+	GENERATED_USTRUCT_BODY()
+
+	// Encode the root and all the bones as a keyframe, the keyframe transforms are set to the encoded bones,
+	// otherwise the bones changed above the thresholds since the keyframe (the keyframe transforms are kept)
+	void Encode(const FTransform& InRoot, const TArray<FTransform>& InBoneTransforms, TArray<FTransform>& InOutKeyframeTransforms,
+		bool bInKeyframe, float InLocationThreshold, float InRotationThreshold);
+
+	// Apply the encoded bones to the component space transforms
+	void Decode(TArray<FTransform>& InOutBoneTransforms) const;
+
+	// Root transform, without scale
+	FTransform GetRoot() const;
+
+	// Serialize the quantized pose
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+
+	// A new pose is replicated with every encoded update
+	bool operator==(const FMCQuantizedHandPose& Other) const { return Sequence == Other.Sequence; }
+
+	// Size on the wire, upper bound (bytes)
+	int32 GetNumBytes() const;
+
+	// Encoded update number
+	uint16 Sequence = 0;
+
+	// Sequence of the keyframe the bones are relative to (its own sequence for a keyframe)
+	uint16 KeyframeSequence = 0;
+
+	// Server time of the pose (s)
+	float ServerTime = 0.f;
+
+	// Root location (world space)
+	FVector RootLocation = FVector::ZeroVector;
+
+	// Smallest three packed root rotation (world space)
+	uint64 RootRotation = 0;
+
+	// All the bones (keyframe) or the bones changed since the keyframe
+	TArray<FMCQuantizedBone> Bones;
+};
+
+template<>
+struct TStructOpsTypeTraits<FMCQuantizedHandPose> : public TStructOpsTypeTraitsBase2<FMCQuantizedHandPose>
+{
+	enum
+	{
+		WithNetSerializer = true,
+		WithIdenticalViaEquality = true
+	};
+};
+
+/**
+ * Replicated hand pose as the root transform and the local rotations of the finger joints,
+ * the remaining bones are rebuilt from the reference pose by forward kinematics
+ */
+USTRUCT()
+struct UPHYSICSBASEDMC_API FMCJointAnglesHandPose
+{
+	GENERATED_USTRUCT_BODY()
+
+	// Encode the root and the local joint rotations, the number of mesh bones is only used for the byte stats
+	void Encode(const FTransform& InRoot, const TArray<FQuat>& InJointRotations, int32 InNumBones);
+
+	// Local joint rotations
+	void Decode(TArray<FQuat>& OutJointRotations) const;
+
+	// Root transform, without scale
+	FTransform GetRoot() const;
+
+	// Serialize the packed pose
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+
+	// A new pose is replicated with every encoded update
+	bool operator==(const FMCJointAnglesHandPose& Other) const { return Sequence == Other.Sequence; }
+
+	// Size on the wire, upper bound (bytes)
+	int32 GetNumBytes() const;
+
+	// Encoded update number
+	uint16 Sequence = 0;
+
+	// Server time of the pose (s)
+	float ServerTime = 0.f;
+
+	// Root location (world space)
+	FVector RootLocation = FVector::ZeroVector;
+
+	// Smallest three packed root rotation (world space)
+	uint64 RootRotation = 0;
+
+	// Smallest three packed local joint rotations, in the grasp pose joint order
+	TArray<uint32> JointRotations;
+};
+
+template<>
+struct TStructOpsTypeTraits<FMCJointAnglesHandPose> : public TStructOpsTypeTraitsBase2<FMCJointAnglesHandPose>
+{
+	enum
+	{
+		WithNetSerializer = true,
+		WithIdenticalViaEquality = true
+	};
+};
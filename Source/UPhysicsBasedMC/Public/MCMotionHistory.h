@@ -0,0 +1,76 @@
+// Copyright 2018, Institute for Artificial Intelligence - University of Bremen
+// Author: Andrei Haidu (http://haidu.eu)
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+* Ring buffer of the latest timestamped locations,
+* estimates velocity and acceleration with finite differences over the whole window
+*/
+struct FMCMotionHistory
+{
+	// Clear the history and set its size (at least 3 samples are needed for the acceleration)
+	void Reset(int32 InSize)
+	{
+		Locations.SetNumZeroed(FMath::Max(InSize, 3));
+		Times.SetNumZeroed(Locations.Num());
+		Head = INDEX_NONE;
+		Count = 0;
+	}
+
+	// Add the newest sample
+	void Add(const FVector& InLocation, double InTime)
+	{
+		if (Locations.Num() == 0)
+		{
+			Reset(3);
+		}
+		Head = (Head + 1) % Locations.Num();
+		Locations[Head] = InLocation;
+		Times[Head] = InTime;
+		Count = FMath::Min(Count + 1, Locations.Num());
+	}
+
+	// Estimate the velocity and acceleration, false if there are not enough samples yet
+	bool Estimate(FVector& OutVelocity, FVector& OutAcceleration) const
+	{
+		if (Count < 3)
+		{
+			return false;
+		}
+
+		// Newest, middle and oldest samples of the window
+		const int32 Num = Locations.Num();
+		const int32 Newest = Head;
+		const int32 Middle = (Head - Count / 2 + Num) % Num;
+		const int32 Oldest = (Head - (Count - 1) + Num) % Num;
+
+		const double NewDeltaTime = Times[Newest] - Times[Middle];
+		const double OldDeltaTime = Times[Middle] - Times[Oldest];
+		if (NewDeltaTime <= SMALL_NUMBER || OldDeltaTime <= SMALL_NUMBER)
+		{
+			return false;
+		}
+
+		const FVector NewVelocity = (Locations[Newest] - Locations[Middle]) / NewDeltaTime;
+		const FVector OldVelocity = (Locations[Middle] - Locations[Oldest]) / OldDeltaTime;
+		OutVelocity = (Locations[Newest] - Locations[Oldest]) / (NewDeltaTime + OldDeltaTime);
+		OutAcceleration = (NewVelocity - OldVelocity) / (0.5 * (NewDeltaTime + OldDeltaTime));
+		return true;
+	}
+
+private:
+	// Sample locations
+	TArray<FVector> Locations;
+
+	// Sample times
+	TArray<double> Times;
+
+	// Index of the newest sample
+	int32 Head = INDEX_NONE;
+
+	// Number of valid samples
+	int32 Count = 0;
+};
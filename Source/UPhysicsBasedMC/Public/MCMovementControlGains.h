@@ -0,0 +1,51 @@
+// Copyright 2018, Institute for Artificial Intelligence - University of Bremen
+// Author: Andrei Haidu (http://haidu.eu)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DataAsset.h"
+#include "PIDController3D.h"
+#include "MCMovementController6D.h"
+#include "MCMovementControlGains.generated.h"
+
+/**
+ * Movement control types and gains of a hand, written by the tuning commandlet
+ */
+UCLASS(BlueprintType)
+class UPHYSICSBASEDMC_API UMCMovementControlGains : public UDataAsset
+{
+	GENERATED_BODY()
+
+public:
+	// Constructor, set default values
+	UMCMovementControlGains();
+
+	// Location controller type the gains were tuned for
+	UPROPERTY(EditAnywhere, Category = "Movement Control")
+	EMCLocationControlType LocationControlType;
+
+	// Rotation controller type the gains were tuned for
+	UPROPERTY(EditAnywhere, Category = "Movement Control")
+	EMCRotationControlType RotationControlType;
+
+	// Location PID gains
+	UPROPERTY(EditAnywhere, Category = "Movement Control")
+	FPIDController3D LocationPIDController;
+
+	// Rotation PID gains
+	UPROPERTY(EditAnywhere, Category = "Movement Control")
+	FPIDController3D RotationPIDController;
+
+	// Full rotation PID on the axis-angle error (otherwise P only)
+	UPROPERTY(EditAnywhere, Category = "Movement Control")
+	bool bUseRotationPID;
+
+	// Physics substeps per frame the gains were tuned with (informative)
+	UPROPERTY(VisibleAnywhere, Category = "Tuning")
+	int32 Substeps;
+
+	// Cost of the tuned gains on the tuning trajectory (informative)
+	UPROPERTY(VisibleAnywhere, Category = "Tuning")
+	float TuningCost;
+};
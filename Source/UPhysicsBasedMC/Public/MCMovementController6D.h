@@ -6,9 +6,16 @@
 #include "CoreMinimal.h"
 #include "Components/SkeletalMeshComponent.h"
 #include "MotionControllerComponent.h"
+#include "PhysicsEngine/BodyInstance.h"
+#include "HAL/CriticalSection.h"
 #include "PIDController3D.h"
+#include "MCPosePredictor.h"
+#include "MCMotionHistory.h"
+#include "MCDistributedControl.h"
 #include "MCMovementController6D.generated.h"
 
+class UMCMovementControlGains;
+
 /**
 * Location control type of the hands
 */
@@ -37,6 +44,30 @@ enum class EMCRotationControlType : uint8
 	Position				UMETA(DisplayName = "Position"),
 };
 
+/**
+* Motion controller pose sample, handed over from the game thread to the physics step
+*/
+struct FMCTrackerSample
+{
+	// Sampled world location
+	FVector Location = FVector::ZeroVector;
+
+	// Sampled world rotation
+	FQuat Quat = FQuat::Identity;
+
+	// Estimated velocity, scaled by the feed-forward gain
+	FVector Velocity = FVector::ZeroVector;
+
+	// Estimated acceleration, scaled by the feed-forward gain
+	FVector Acceleration = FVector::ZeroVector;
+
+	// Platform time of the sample (seconds)
+	double Time = 0.0;
+
+	// Set when the sample has been applied in a physics step
+	bool bApplied = false;
+};
+
 /**
  * 3D Movement controller of the hand
  */
@@ -52,13 +83,69 @@ public:
 	// Init hand with the motion controllers
 	void Init(USkeletalMeshComponent* InHand, UMotionControllerComponent* InMC);
 
+	// Called when actor removed from game or game ended
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	// Called every frame if the late update is enabled
+	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
 	// Update the movement
 	void Update(const float DeltaTime);
 
+	// Time between the latest motion controller sample and the physics step applying it (ms)
+	float GetMCToPhysicsLatency() const { return MCToPhysicsLatency; }
+
+	// Filtered linear velocity of the motion controller (zero without pose prediction)
+	FVector GetMCLinearVelocity() const { return PosePredictor.GetLinearVelocity(); }
+
+	// Filtered angular velocity of the motion controller in rad/s (zero without pose prediction)
+	FVector GetMCAngularVelocity() const { return PosePredictor.GetAngularVelocity(); }
+
 	// Use scene component as a tracking offset
 	UPROPERTY(EditAnywhere, Category = "Movement Control")
 	bool bUseTrackingOffset;
 
+	// Track the offset component with every feedback control, otherwise only the acceleration based location control tracks it
+	UPROPERTY(EditAnywhere, Category = "Movement Control", meta = (editcondition = "bUseTrackingOffset"))
+	bool bTrackingOffsetForAllControls;
+
+	// Run the control functions in every physics substep (substepping has to be enabled in the physics settings)
+	UPROPERTY(EditAnywhere, Category = "Movement Control")
+	bool bSubstepSync;
+
+	// Poll the tracker right before the physics step and update the control from the pre physics tick group
+	// (with the batched update the manager ticks before physics and the tracker is polled when sampling)
+	UPROPERTY(EditAnywhere, Category = "Movement Control")
+	bool bLateUpdate;
+
+	// Let the world movement controller manager update this controller in one batch with all the others
+	UPROPERTY(EditAnywhere, Category = "Movement Control")
+	bool bBatchedUpdate;
+
+	// Filter the motion controller pose and follow its extrapolation to compensate the tracking latency
+	UPROPERTY(EditAnywhere, Category = "Movement Control")
+	bool bUsePosePrediction;
+
+	// Motion controller pose filter
+	UPROPERTY(EditAnywhere, Category = "Movement Control", meta = (editcondition = "bUsePosePrediction"))
+	FMCPosePredictor PosePredictor;
+
+	// Add the motion controller velocity (velocity control) or acceleration (force and acceleration control) to the location PID output
+	UPROPERTY(EditAnywhere, Category = "Movement Control")
+	bool bUseFeedForward;
+
+	// Gain of the velocity feed-forward term
+	UPROPERTY(EditAnywhere, Category = "Movement Control", meta = (editcondition = "bUseFeedForward"))
+	float FeedForwardVelocityGain;
+
+	// Gain of the acceleration feed-forward term
+	UPROPERTY(EditAnywhere, Category = "Movement Control", meta = (editcondition = "bUseFeedForward"))
+	float FeedForwardAccelerationGain;
+
+	// Number of motion controller samples used for the finite difference estimation (not used with pose prediction)
+	UPROPERTY(EditAnywhere, Category = "Movement Control", meta = (editcondition = "bUseFeedForward", ClampMin = 3))
+	int32 FeedForwardHistorySize;
+
 	//// Custom bone for tracking location
 	//UPROPERTY(EditAnywhere, Category = "Movement Control", meta = (editcondition = "bUseTrackingOffset"))
 	//USceneComponent* TrackingOffsetComp;
@@ -80,6 +167,26 @@ public:
 	UPROPERTY(EditAnywhere, Category = "Movement Control")
 	FPIDController3D RotationPIDController;
 
+	// Run the full rotation PID on the axis-angle error, damped with the measured angular velocity (otherwise P only)
+	UPROPERTY(EditAnywhere, Category = "Movement Control")
+	bool bUseRotationPID;
+
+	// Drive every body of the hand physics asset towards its reference pose relative to the target, not only the root body
+	UPROPERTY(EditAnywhere, Category = "Movement Control")
+	bool bDistributedControl;
+
+	// Gain multipliers of the bones with distributed control (default 1)
+	UPROPERTY(EditAnywhere, Category = "Movement Control", meta = (editcondition = "bDistributedControl"))
+	TMap<FName, float> BoneGainMultipliers;
+
+	// Also control the finger bodies driven by the grasp controller of the hand, otherwise they follow their joint drives
+	UPROPERTY(EditAnywhere, Category = "Movement Control", meta = (editcondition = "bDistributedControl"))
+	bool bControlGraspDrivenBodies;
+
+	// Tuned control types and gains, if set they override the values above at init
+	UPROPERTY(EditAnywhere, Category = "Movement Control")
+	UMCMovementControlGains* ControlGains;
+
 	// Location controller type
 	UPROPERTY(EditAnywhere, Category = "Movement Control")
 	EMCLocationControlType LocationControlType;
@@ -89,39 +196,138 @@ public:
 	EMCRotationControlType RotationControlType;
 
 private:
+	// The batched update reads the controller data directly
+	friend class AMCMovementControllerManager;
+
+	// The dispatch benchmark runs the control kernels directly
+	friend class UMCControlBenchCommandlet;
+
+	// Called by the physics scene in every substep, the scene is already locked
+	void SubstepUpdate(float DeltaTime, FBodyInstance* InBodyInstance);
+
+	// Called by the physics scene when the per frame control outputs are applied
+	void LatencyUpdate(float DeltaTime, FBodyInstance* InBodyInstance);
+
+	// Sample the motion controller pose and hand it over to the physics step
+	void SampleMotionController();
+
+	// Poll the tracking system directly for the freshest motion controller pose
+	bool PollMotionController(FVector& OutLocation, FQuat& OutQuat) const;
+
+	// Read the latest motion controller sample into the control target (thread safe)
+	void ReadMotionControllerSample();
+
+	// Measure the time between the latest sample and its first physics application (thread safe)
+	void RecordMCToPhysicsLatency();
+
+	// Estimate the feed-forward velocity and acceleration of the motion controller
+	void EstimateFeedForward(const FVector& InLocation, double InTime, FVector& OutVelocity, FVector& OutAcceleration);
+
+	// Location feed-forward term of the location control type (physics scene has to be locked)
+	FVector GetLocationFeedForward_AssumesLocked() const;
+
+	// Control all the bodies of the hand (physics scene has to be locked)
+	void DistributedUpdate_AssumesLocked(float InDeltaTime);
+
 	// Skeletal mesh component of the hand
 	USkeletalMeshComponent* HandSkelComp;
 
+	// Root body of the hand, all the control outputs are applied to it
+	FBodyInstance* HandBodyInstance;
+
+	// Manager of the batched update, cached at registration (not spawned again at teardown)
+	TWeakObjectPtr<class AMCMovementControllerManager> BatchManager;
+
 	// Motion controller to follow
 	UMotionControllerComponent* MC;
 
 	// Hand rotation offset for hand alignment
 	FQuat HandRotationAlignmentOffset;
 
-	// Control function pointer variable type
-	typedef void(UMCMovementController6D::*MovementControlFuncPtrType)(float);
-
-	// Function pointer for location movement control
-	MovementControlFuncPtrType LocationControlFuncPtr;
-
-	// Function pointer for rotation movement control
-	MovementControlFuncPtrType RotationControlFuncPtr;
-
-	// Location interaction functions types
-	void LocationControl_None(float InDeltaTime);
-	void LocationControl_ForceBased(float InDeltaTime);
-	void LocationControl_AccelBased(float InDeltaTime);
-	void LocationControl_AccelBased_Offset(float InDeltaTime);
-	void LocationControl_ImpulseBased(float InDeltaTime);
-	void LocationControl_VelBased(float InDeltaTime);
-	void LocationControl_PosBased(float InDeltaTime);
-
-	// Rotation interaction function types
-	void RotationControl_None(float InDeltaTime);
-	void RotationControl_TorqueBased(float InDeltaTime);
-	void RotationControl_AccelBased(float InDeltaTime);
-	void RotationControl_ImpulseBased(float InDeltaTime);
-	void RotationControl_VelBased(float InDeltaTime);
-	void RotationControl_VelBased_Offset(float InDeltaTime);
-	void RotationControl_PosBased(float InDeltaTime);	
+	// Substep callback delegate, bound to SubstepUpdate
+	FCalculateCustomPhysics OnCalculateCustomPhysics;
+
+	// Physics step callback delegate for measuring the latency of per frame updates, bound to LatencyUpdate
+	FCalculateCustomPhysics OnCalculateLatency;
+
+	// Latest motion controller sample, written by the game thread, read by the physics step
+	FMCTrackerSample LatestSample;
+
+	// Guards the latest sample
+	FCriticalSection SampleCriticalSection;
+
+	// Time between the latest sample and its first physics application (ms)
+	float MCToPhysicsLatency;
+
+	// Hand component transform relative to its root body
+	FTransform HandToBodyOffset;
+
+	// Tracking offset (this component) transform relative to the hand root body
+	FTransform TrackingToBodyOffset;
+
+	// Motion controller pose used by the current control step
+	FVector MCLocation;
+	FQuat MCQuat;
+
+	// Motion controller feed-forward velocity and acceleration used by the current control step
+	FVector MCVelocity;
+	FVector MCAcceleration;
+
+	// Latest motion controller locations for the finite difference estimation
+	FMCMotionHistory MCMotionHistory;
+
+	// Per bone control of the hand bodies
+	FMCDistributedControl DistributedControl;
+
+	// Root body transform of the current control step, read directly from the body
+	FTransform BodyTransform;
+
+	// The location and the rotation control follow the tracking offset instead of the hand
+	bool bLocationTrackingOffset;
+	bool bRotationTrackingOffset;
+
+	// Integral of the rotation error (axis-angle)
+	FVector RotationErrorIntegral;
+
+	// Let the physics scene spread forces over the substeps (false while running inside a substep)
+	bool bAllowSubstepping;
+
+	// Control kernel type, one kernel runs both the location and the rotation control
+	typedef void(UMCMovementController6D::*ControlKernelType)(float);
+
+	// Kernel running from the game thread
+	ControlKernelType FrameKernel;
+
+	// Kernel running from the physics substeps
+	ControlKernelType SubstepKernel;
+
+	// Location and rotation control, specialized for every policy combination
+	template<bool bSceneLocked, bool bLocationOffset, bool bRotationOffset, class TLocationPolicy, class TRotationPolicy>
+	void ControlKernel(float InDeltaTime);
+
+	// Feedback part of the control, reads the body pose and writes the outputs (physics scene has to be locked)
+	template<bool bLocationOffset, bool bRotationOffset, class TLocationPolicy, class TRotationPolicy>
+	void FeedbackControl_AssumesLocked(float InDeltaTime);
+
+	// Current location of the controlled point
+	template<bool bLocationOffset>
+	FVector GetControlledLocation() const;
+
+	// Current rotation of the controlled point
+	template<bool bRotationOffset>
+	FQuat GetControlledQuat() const;
+
+	// Rotation control output, P only or full PID (physics scene has to be locked)
+	FVector GetRotationOutput_AssumesLocked(const FQuat& InTargetQuat, const FQuat& InCurrQuat, float InDeltaTime);
+
+	// Select the frame and substep kernels of the control types and the controlled points
+	void SelectKernels();
+
+	// Select the kernel of the control types
+	template<bool bSceneLocked, bool bLocationOffset, bool bRotationOffset>
+	ControlKernelType SelectKernel() const;
+
+	// Select the kernel of the rotation control type with the given location policy
+	template<bool bSceneLocked, bool bLocationOffset, bool bRotationOffset, class TLocationPolicy>
+	ControlKernelType SelectKernelWithRotation() const;
 };
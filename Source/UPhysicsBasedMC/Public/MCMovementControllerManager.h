@@ -0,0 +1,122 @@
+// Copyright 2018, Institute for Artificial Intelligence - University of Bremen
+// Author: Andrei Haidu (http://haidu.eu)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Info.h"
+#include "PhysicsEngine/BodyInstance.h"
+#include "MCMovementController6D.h"
+#include "MCMovementControllerManager.generated.h"
+
+/**
+ * Updates all the registered movement controllers of the world in one batch,
+ * the controller data is kept in structure-of-arrays buffers
+ */
+UCLASS(NotPlaceable, Transient)
+class UPHYSICSBASEDMC_API AMCMovementControllerManager : public AInfo
+{
+	GENERATED_BODY()
+
+public:
+	// Sets default values
+	AMCMovementControllerManager();
+
+	// Get the manager of the world, spawn one if none is available
+	static AMCMovementControllerManager* GetInstance(UWorld* InWorld);
+
+	// Called every frame, before physics
+	virtual void Tick(float DeltaTime) override;
+
+	// Add the controller to the batch, the control types are fixed at registration, the gains are read every frame
+	void Register(UMCMovementController6D* InController);
+
+	// Remove the controller from the batch
+	void Unregister(UMCMovementController6D* InController);
+
+	// Number of registered controllers
+	int32 Num() const { return Controllers.Num(); }
+
+	// Run the batch in every physics substep (substepping has to be enabled in the physics settings)
+	UPROPERTY(EditAnywhere, Category = "Movement Control")
+	bool bSubstepSync;
+
+	// Evaluate the batch on a single thread below this number of controllers
+	UPROPERTY(EditAnywhere, Category = "Movement Control", meta = (ClampMin = 1))
+	int32 MinParallelBatchSize;
+
+private:
+	// Copy the current PID gains of the controller
+	void ReadGains(int32 Idx);
+
+	// Called by the physics scene in every substep, the scene is already locked
+	void SubstepUpdate(float DeltaTime, FBodyInstance* InBodyInstance);
+
+	// Read the poses and the feed-forward terms of all the bodies (physics scene has to be locked)
+	void ReadBodyPoses_AssumesLocked();
+
+	// Compute the control outputs of all the controllers
+	void Evaluate(float DeltaTime);
+
+	// Apply the control outputs to all the bodies (physics scene has to be locked)
+	void WriteOutputs_AssumesLocked(bool bAllowSubstepping);
+
+	// Substep callback delegate, bound to SubstepUpdate
+	FCalculateCustomPhysics OnCalculateCustomPhysics;
+
+	/* Per controller data (same index in every array) */
+	// Registered controllers
+	TArray<UMCMovementController6D*> Controllers;
+
+	// Controlled root bodies
+	TArray<FBodyInstance*> Bodies;
+
+	// Control types
+	TArray<EMCLocationControlType> LocationControlTypes;
+	TArray<EMCRotationControlType> RotationControlTypes;
+
+	// Controlled location and rotation offsets relative to the root bodies
+	TArray<FTransform> LocationToBodyOffsets;
+	TArray<FTransform> RotationToBodyOffsets;
+
+	// Hand rotation alignment offsets
+	TArray<FQuat> RotationAlignmentOffsets;
+
+	// Motion controller targets
+	TArray<FVector> TargetLocations;
+	TArray<FQuat> TargetQuats;
+
+	// Location feed-forward terms
+	TArray<FVector> LocationFeedForwards;
+
+	// Current poses of the controlled points
+	TArray<FVector> Locations;
+	TArray<FQuat> Quats;
+
+	// Current angular velocities of the bodies (only read for the full rotation PID)
+	TArray<FVector> AngularVelocities;
+
+	// Location PID gains
+	TArray<float> LocationP;
+	TArray<float> LocationI;
+	TArray<float> LocationD;
+	TArray<float> LocationMaxOutAbs;
+
+	// Rotation PID gains, only the P gain is used without the full rotation PID
+	TArray<bool> RotationPIDEnabled;
+	TArray<float> RotationP;
+	TArray<float> RotationI;
+	TArray<float> RotationD;
+	TArray<float> RotationMaxOutAbs;
+
+	// Location PID state
+	TArray<FVector> LocationPrevErrors;
+	TArray<FVector> LocationIntegrals;
+
+	// Rotation PID state
+	TArray<FVector> RotationIntegrals;
+
+	// Control outputs
+	TArray<FVector> LocationOutputs;
+	TArray<FVector> RotationOutputs;
+};
@@ -32,6 +32,9 @@ public:
 
 	// Called to bind functionality to input
 	virtual void SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent) override;
+
+	// Update at the rate and priority of the fastest moving hand if every hand is adaptive
+	virtual void PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker) override;
 	
 	// VR Camera
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "MC")
@@ -58,5 +61,13 @@ private:
 	// Display MC controller mesh
 	UPROPERTY(EditAnywhere, Category = "MC", DisplayName = "Visualize MC Meshes")
 	bool bVisualizeMCMeshes;
+
+	// Minimum net updates per second with adaptive hand replication, the pawn movement and the camera are replicated with the hands
+	UPROPERTY(EditAnywhere, Category = "MC", meta = (ClampMin = 0))
+	float MinAdaptiveNetUpdateFrequency;
+
+	// Net update frequency and priority before the hands scale them
+	float DefaultNetUpdateFrequency;
+	float DefaultNetPriority;
 };
 
@@ -0,0 +1,35 @@
+// Copyright 2018, Institute for Artificial Intelligence - University of Bremen
+// Author: Andrei Haidu (http://haidu.eu)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "MCPoseBenchCommandlet.generated.h"
+
+/**
+ * Headless micro-benchmark of the hand pose capture and application,
+ * the bone getters and setters by name of a poseable mesh component are compared
+ * with the cached index bulk conversions on transient hand meshes
+ *
+ * UE4Editor-Cmd <Project> -run=MCPoseBench -nullrhi [-Bones=30,60] [-Iterations=10000]
+ */
+UCLASS()
+class UPHYSICSBASEDMC_API UMCPoseBenchCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	// Constructor, set default values
+	UMCPoseBenchCommandlet();
+
+	// Run the benchmark for every bone count
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	// Benchmark the capture and the application of a hand pose with the given number of bones
+	void RunBenchmark(int32 NumBones) const;
+
+	// Number of repetitions of every measurement
+	int32 Iterations;
+};
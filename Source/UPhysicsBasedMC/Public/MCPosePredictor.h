@@ -0,0 +1,93 @@
+// Copyright 2018, Institute for Artificial Intelligence - University of Bremen
+// Author: Andrei Haidu (http://haidu.eu)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MCPosePredictor.generated.h"
+
+/**
+* Alpha-beta(-gamma) filter on the motion controller pose,
+* estimates the linear and angular velocity and extrapolates the pose by a time horizon.
+* Independent of any component, it can be fed with recorded pose streams.
+*/
+USTRUCT()
+struct UPHYSICSBASEDMC_API FMCPosePredictor
+{
+	GENERATED_USTRUCT_BODY()
+
+public:
+	// Constructor, set default values
+	FMCPosePredictor();
+
+	// Clear the filter state, the next sample will re-initialize it
+	void Reset();
+
+	// Filter a new pose sample taken DeltaTime seconds after the previous one
+	void Update(const FVector& InLocation, const FQuat& InQuat, float DeltaTime);
+
+	// Filtered pose extrapolated by the prediction horizon
+	void GetPredictedPose(FVector& OutLocation, FQuat& OutQuat) const;
+
+	// Filtered pose extrapolated by the given time
+	void Extrapolate(float Time, FVector& OutLocation, FQuat& OutQuat) const;
+
+	// Filtered linear velocity (cm/s)
+	FVector GetLinearVelocity() const { return LinearVelocity; }
+
+	// Filtered linear acceleration (cm/s^2), zero if the acceleration is not estimated
+	FVector GetLinearAcceleration() const { return LinearAcceleration; }
+
+	// Filtered angular velocity (rad/s)
+	FVector GetAngularVelocity() const { return AngularVelocity; }
+
+	// True if the filter received at least one sample
+	bool IsInitialized() const { return bInitialized; }
+
+	// Time to extrapolate the target pose with (s)
+	UPROPERTY(EditAnywhere, Category = "Pose Prediction", meta = (ClampMin = 0))
+	float PredictionHorizon;
+
+	// Position correction gain
+	UPROPERTY(EditAnywhere, Category = "Pose Prediction", meta = (ClampMin = 0, ClampMax = 1))
+	float Alpha;
+
+	// Velocity correction gain
+	UPROPERTY(EditAnywhere, Category = "Pose Prediction", meta = (ClampMin = 0, ClampMax = 2))
+	float Beta;
+
+	// Estimate the linear acceleration as well (constant acceleration model)
+	UPROPERTY(EditAnywhere, Category = "Pose Prediction")
+	bool bEstimateAcceleration;
+
+	// Acceleration correction gain
+	UPROPERTY(EditAnywhere, Category = "Pose Prediction", meta = (ClampMin = 0, ClampMax = 1, editcondition = "bEstimateAcceleration"))
+	float Gamma;
+
+	// Orientation correction gain
+	UPROPERTY(EditAnywhere, Category = "Pose Prediction", meta = (ClampMin = 0, ClampMax = 1))
+	float RotationAlpha;
+
+	// Angular velocity correction gain
+	UPROPERTY(EditAnywhere, Category = "Pose Prediction", meta = (ClampMin = 0, ClampMax = 2))
+	float RotationBeta;
+
+private:
+	// Filtered location
+	FVector Location;
+
+	// Filtered linear velocity
+	FVector LinearVelocity;
+
+	// Filtered linear acceleration
+	FVector LinearAcceleration;
+
+	// Filtered orientation
+	FQuat Quat;
+
+	// Filtered angular velocity (world frame)
+	FVector AngularVelocity;
+
+	// Set with the first sample
+	bool bInitialized;
+};
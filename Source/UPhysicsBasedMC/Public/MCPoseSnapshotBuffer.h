@@ -0,0 +1,131 @@
+// Copyright 2018, Institute for Artificial Intelligence - University of Bremen
+// Author: Andrei Haidu (http://haidu.eu)
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+* Received hand pose at a server time
+*/
+struct FMCPoseSnapshot
+{
+	// Server time of the pose (s)
+	double Time = 0.0;
+
+	// Root pose
+	FTransform Root;
+
+	// Bone transforms of the pose replication mode
+	TArray<FTransform> Bones;
+
+	// Attached mesh state at the time of the pose
+	bool bHasAttached = false;
+	FTransform AttachedTransform;
+};
+
+/**
+* Jitter buffer of the latest received hand poses,
+* played back with a delay by interpolating between the snapshots around the playback time
+*/
+struct FMCPoseSnapshotBuffer
+{
+	// Clear the buffer and set its size (at least 2 snapshots are needed for the interpolation)
+	void Reset(int32 InSize)
+	{
+		Snapshots.SetNum(FMath::Max(InSize, 2));
+		Head = INDEX_NONE;
+		Count = 0;
+	}
+
+	// Add the newest snapshot, returns the snapshot to fill or nullptr if it is older than the newest one
+	FMCPoseSnapshot* Add(double InTime)
+	{
+		if (Snapshots.Num() == 0)
+		{
+			Reset(2);
+		}
+		if (Count > 0 && InTime <= Snapshots[Head].Time)
+		{
+			return nullptr;
+		}
+		Head = (Head + 1) % Snapshots.Num();
+		Count = FMath::Min(Count + 1, Snapshots.Num());
+		Snapshots[Head].Time = InTime;
+		return &Snapshots[Head];
+	}
+
+	// Interpolate the pose at the playback time, extrapolate at most the given time past the newest snapshot,
+	// false if the buffer is empty
+	bool Sample(double InTime, double InMaxExtrapolation, FMCPoseSnapshot& OutSnapshot) const
+	{
+		if (Count == 0)
+		{
+			return false;
+		}
+
+		const int32 Num = Snapshots.Num();
+		const FMCPoseSnapshot& Newest = Snapshots[Head];
+		if (Count == 1 || InTime <= Snapshots[(Head - (Count - 1) + Num) % Num].Time)
+		{
+			// Nothing to interpolate with, hold the newest or the oldest snapshot
+			OutSnapshot = Count == 1 ? Newest : Snapshots[(Head - (Count - 1) + Num) % Num];
+			return true;
+		}
+
+		// Newer pair around the playback time, or the newest pair when extrapolating lost updates
+		int32 NewerIdx = Head;
+		for (int32 Age = 0; Age < Count - 1; ++Age)
+		{
+			const int32 OlderIdx = (NewerIdx - 1 + Num) % Num;
+			if (Snapshots[OlderIdx].Time <= InTime)
+			{
+				break;
+			}
+			NewerIdx = OlderIdx;
+		}
+		const FMCPoseSnapshot& Newer = Snapshots[NewerIdx];
+		const FMCPoseSnapshot& Older = Snapshots[(NewerIdx - 1 + Num) % Num];
+
+		const double Time = FMath::Min(InTime, Newest.Time + InMaxExtrapolation);
+		const float Alpha = static_cast<float>((Time - Older.Time) / FMath::Max(Newer.Time - Older.Time, double(SMALL_NUMBER)));
+		Interpolate(Older, Newer, Alpha, OutSnapshot);
+		OutSnapshot.Time = Time;
+		return true;
+	}
+
+private:
+	// Lerp the locations and slerp the rotations, alpha above one extrapolates
+	static FTransform Interpolate(const FTransform& A, const FTransform& B, float Alpha)
+	{
+		return FTransform(
+			FQuat::Slerp(A.GetRotation(), B.GetRotation(), Alpha),
+			FMath::Lerp(A.GetLocation(), B.GetLocation(), Alpha));
+	}
+
+	// Interpolate the root, the bones and the attached mesh
+	static void Interpolate(const FMCPoseSnapshot& A, const FMCPoseSnapshot& B, float Alpha, FMCPoseSnapshot& OutSnapshot)
+	{
+		OutSnapshot.Root = Interpolate(A.Root, B.Root, Alpha);
+		OutSnapshot.Bones.SetNum(B.Bones.Num(), false);
+		for (int32 Idx = 0; Idx < B.Bones.Num(); ++Idx)
+		{
+			OutSnapshot.Bones[Idx] = A.Bones.IsValidIndex(Idx) ? Interpolate(A.Bones[Idx], B.Bones[Idx], Alpha) : B.Bones[Idx];
+		}
+
+		// The attached mesh is only interpolated while attached in both snapshots
+		OutSnapshot.bHasAttached = B.bHasAttached;
+		OutSnapshot.AttachedTransform = A.bHasAttached && B.bHasAttached
+			? Interpolate(A.AttachedTransform, B.AttachedTransform, Alpha)
+			: B.AttachedTransform;
+	}
+
+	// Snapshots, the bone arrays are reused
+	TArray<FMCPoseSnapshot> Snapshots;
+
+	// Index of the newest snapshot
+	int32 Head = INDEX_NONE;
+
+	// Number of valid snapshots
+	int32 Count = 0;
+};
@@ -0,0 +1,56 @@
+// Copyright 2018, Institute for Artificial Intelligence - University of Bremen
+// Author: Andrei Haidu (http://haidu.eu)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "PhysicsEngine/ConstraintInstance.h"
+
+class USkeletalMesh;
+class UPhysicsAsset;
+
+/**
+* Bone and constraint indices of a skeletal mesh and its physics asset,
+* built once and shared by every hand using the same mesh and physics asset
+*/
+struct UPHYSICSBASEDMC_API FMCSkeletonIndexMap
+{
+	// Get the shared map of the mesh and physics asset of the component (game thread only)
+	static TSharedPtr<const FMCSkeletonIndexMap> Get(const USkeletalMeshComponent* InComponent);
+
+	// Bone index of the bone name, INDEX_NONE if not found
+	int32 GetBoneIndex(FName InBoneName) const
+	{
+		const int32* Idx = BoneIndices.Find(InBoneName);
+		return Idx ? *Idx : INDEX_NONE;
+	}
+
+	// Constraint index of the joint name, INDEX_NONE if not found
+	int32 GetConstraintIndex(FName InJointName) const
+	{
+		const int32* Idx = ConstraintIndices.Find(InJointName);
+		return Idx ? *Idx : INDEX_NONE;
+	}
+
+	// Constraint instance of the component with the given joint name, nullptr if not found
+	FConstraintInstance* FindConstraint(const USkeletalMeshComponent* InComponent, FName InJointName) const;
+
+	// Convert the world or component space transforms of all the bones to bone space in one pass,
+	// the root bones are made relative to the given root parent (e.g. the component transform for world space)
+	static void ToBoneSpace(const TArray<int32>& InParentIndices, const TArray<FTransform>& InTransforms,
+		const FTransform& InRootParent, TArray<FTransform>& OutBoneSpaceTransforms);
+
+	// Names of all the bones, in bone index order
+	TArray<FName> BoneNames;
+
+	// Parent bone indices of all the bones, INDEX_NONE for the root
+	TArray<int32> ParentIndices;
+
+private:
+	// Bone name to bone index
+	TMap<FName, int32> BoneIndices;
+
+	// Joint name to constraint index (physics asset constraint setup order)
+	TMap<FName, int32> ConstraintIndices;
+};
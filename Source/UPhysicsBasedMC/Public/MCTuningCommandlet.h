@@ -0,0 +1,120 @@
+// Copyright 2018, Institute for Artificial Intelligence - University of Bremen
+// Author: Andrei Haidu (http://haidu.eu)
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "MCMovementController6D.h"
+#include "MCTuningCommandlet.generated.h"
+
+class UMCMovementControlGains;
+
+/**
+* Tracking metrics of a simulated run
+*/
+struct FMCTrackingMetrics
+{
+	// Root mean square location error (cm)
+	float LocationRMSError = 0.f;
+
+	// Location overshoot as fraction of the step size (step trajectories only)
+	float LocationOvershoot = 0.f;
+
+	// Time until the location error stays within the settling band (s, step trajectories only)
+	float LocationSettlingTime = 0.f;
+
+	// Root mean square rotation error (deg)
+	float RotationRMSError = 0.f;
+
+	// Rotation overshoot as fraction of the step angle (step trajectories only)
+	float RotationOvershoot = 0.f;
+
+	// Time until the rotation error stays within the settling band (s, step trajectories only)
+	float RotationSettlingTime = 0.f;
+
+	// CPU time of one control update (microseconds)
+	double MicrosecondsPerUpdate = 0.0;
+
+	// False if the simulation diverged
+	bool bStable = true;
+};
+
+/**
+ * Headless tracking benchmark and gain tuning of the movement control,
+ * the hand root body is simulated as a rigid body driven by the same control computations
+ *
+ * UE4Editor-Cmd <Project> -run=MCTuning -nullrhi [-Tune] [-LocType=Acceleration] [-RotType=Velocity]
+ *     [-Trajectory=Step|Sine|<file.csv>] [-Gains=<asset path>] [-Output=/Game/MC/TunedGains]
+ *     [-FrameRate=90] [-Substeps=4] [-SubstepSync] [-Mass=1] [-Inertia=0.01] [-Iterations=30]
+ *
+ * Recorded sessions are csv files with one "Time,X,Y,Z,QX,QY,QZ,QW" line per sample (cm, s)
+ */
+UCLASS()
+class UPHYSICSBASEDMC_API UMCTuningCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	// Constructor, set default values
+	UMCTuningCommandlet();
+
+	// Run the benchmark or the tuning
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	// Benchmark every location x rotation control type with the given gains
+	void RunBenchmark(const UMCMovementControlGains* InGains);
+
+	// Tune the gains of the given control types and save them as a data asset
+	void RunTuning(UMCMovementControlGains* InGains, const FString& OutputPath);
+
+	// Load the target trajectory
+	bool LoadTrajectory(const FString& TrajectoryName);
+
+	// Interpolated target pose at the given time
+	void SampleTrajectory(float Time, FVector& OutLocation, FQuat& OutQuat) const;
+
+	// Track the trajectory with the given control types and gains
+	FMCTrackingMetrics Simulate(const UMCMovementControlGains* InGains) const;
+
+	// Tuning cost of the location tracking
+	float GetLocationCost(const FMCTrackingMetrics& InMetrics) const;
+
+	// Tuning cost of the rotation tracking
+	float GetRotationCost(const FMCTrackingMetrics& InMetrics) const;
+
+	// Target trajectory samples
+	TArray<float> TrajectoryTimes;
+	TArray<FVector> TrajectoryLocations;
+	TArray<FQuat> TrajectoryQuats;
+
+	// Step trajectories also report overshoot and settling time
+	bool bStepTrajectory;
+
+	// Time of the step
+	float StepTime;
+
+	// Location and rotation change of the step
+	FVector StepLocation;
+	FVector StepRotationVector;
+
+	// Reference scales of the location (cm) and rotation (deg) errors
+	float LocationScale;
+	float RotationScale;
+
+	// Error band around the target for the settling time (fraction of the step)
+	float SettlingBand;
+
+	// Simulation settings
+	float FrameRate;
+	int32 Substeps;
+	bool bSubstepSync;
+	float Mass;
+	float Inertia;
+
+	// Tuning settings
+	int32 Iterations;
+	float OvershootWeight;
+	float SettlingTimeWeight;
+};
@@ -6,6 +6,12 @@
 #include "CoreMinimal.h"
 #include "ModuleManager.h"
 
+// Stats group of the plugin
+DECLARE_STATS_GROUP(TEXT("PhysicsBasedMC"), STATGROUP_PhysicsBasedMC, STATCAT_Advanced);
+
+// Physics scene locks taken by the movement control in a frame
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Physics Scene Locks"), STAT_MCPhysicsSceneLocks, STATGROUP_PhysicsBasedMC, UPHYSICSBASEDMC_API);
+
 class FUPhysicsBasedMCModule : public IModuleInterface
 {
 public: